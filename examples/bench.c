@@ -0,0 +1,54 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static int report_fd = -1;
+
+double bench_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double bench_run(BenchFn *fn, void *arg) {
+  int fds[2];
+  if (pipe(fds) == -1) {
+    perror("pipe");
+    exit(1);
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork");
+    exit(1);
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    report_fd = fds[1];
+    fn(arg);
+    exit(0);
+  }
+
+  close(fds[1]);
+  double value = -1;
+  if (read(fds[0], &value, sizeof(value)) != sizeof(value))
+    value = -1;
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    value = -1;
+  return value;
+}
+
+void bench_report(double value) {
+  if (report_fd == -1)
+    return;
+  if (write(report_fd, &value, sizeof(value)) != sizeof(value))
+    perror("write");
+  close(report_fd);
+  report_fd = -1;
+}
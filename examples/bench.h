@@ -0,0 +1,16 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+typedef void BenchFn(void *);
+
+// monotonic clock in seconds
+double bench_now();
+
+// Runs fn(arg) in a forked child, because run_async_main never returns, and
+// returns whatever the child passed to bench_report, or -1 if it failed.
+double bench_run(BenchFn *fn, void *arg);
+
+// called once by the benchmarked child to hand its result to bench_run
+void bench_report(double value);
+
+#endif // !__BENCH_H__
@@ -0,0 +1,96 @@
+// CALLS blocking calls next to a ticker task that only yields: writes of 4KB
+// each followed by an fsync on a file of its own, and 1ms sleeps standing in
+// for a slow lookup such as getaddrinfo. Inline they block the runtime's
+// thread one after the other and the ticker waits for each of them; handed
+// to async_spawn_blocking they run side by side on the pool while the ticker
+// keeps going. Reports calls per second and the longest the ticker waited.
+#define _GNU_SOURCE
+#include "../src/async.h"
+#include "bench.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifndef CALLS
+#define CALLS 256
+#endif
+
+static volatile int done = 0;
+static double worst = 0;
+
+void ticker(void *args) {
+  double last = bench_now();
+  while (!done) {
+    async_skip();
+    double now = bench_now();
+    if (now - last > worst)
+      worst = now - last;
+    last = now;
+  }
+  async_return(NULL);
+}
+
+void *write_and_sync(void *args) {
+  static char buf[4096];
+  int fd = open(".", O_TMPFILE | O_WRONLY, 0600);
+  if (fd == -1)
+    return perror("open"), exit(1), NULL;
+  if (write(fd, buf, sizeof(buf)) != sizeof(buf) || fsync(fd) == -1)
+    return perror("write"), exit(1), NULL;
+  close(fd);
+  return NULL;
+}
+
+void *slow_lookup(void *args) {
+  usleep(1000);
+  return NULL;
+}
+
+enum { OFFLOAD = 1, REPORT_WAIT = 2, SLEEP = 4 };
+
+void async_main(void *args) {
+  long flags = (long)args;
+  BlockingFunction *call = flags & SLEEP ? slow_lookup : write_and_sync;
+  Handle t = async_call(ticker, NULL);
+  async_skip();
+  double start = bench_now();
+  if (flags & OFFLOAD) {
+    static Handle calls[CALLS];
+    for (int i = 0; i < CALLS; i++)
+      calls[i] = async_spawn_blocking(call, NULL);
+    await_all(calls, CALLS, NULL);
+  } else {
+    for (int i = 0; i < CALLS; i++) {
+      call(NULL);
+      async_skip();
+    }
+  }
+  double elapsed = bench_now() - start;
+  done = 1;
+  await(t);
+  bench_report(flags & REPORT_WAIT ? worst * 1e6 : CALLS / elapsed);
+  async_return(NULL);
+}
+
+void run(void *args) {
+  RuntimeOptions opts = {0};
+  run_async_main_ex(async_main, args, &opts);
+}
+
+int main(int argc, char *argv[]) {
+  printf("call, mode, calls per second, longest ticker wait us\n");
+  static const char *calls[] = {"fsync", "1ms sleep"};
+  static const char *modes[] = {"inline", "async_spawn_blocking"};
+  for (long i = 0; i < 4; i++) {
+    long flags = (i & 2 ? SLEEP : 0) | (i & 1 ? OFFLOAD : 0);
+    double rate = bench_run(run, (void *)flags);
+    double wait = bench_run(run, (void *)(flags | REPORT_WAIT));
+    if (rate < 0 || wait < 0) {
+      fprintf(stderr, "benchmark failed\n");
+      return 1;
+    }
+    printf("%s, %s, %.0f, %.0f\n", calls[i >> 1], modes[i & 1], rate, wait);
+  }
+  return 0;
+}
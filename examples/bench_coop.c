@@ -0,0 +1,84 @@
+// A connection that always finds data ready reads BYTES bytes one at a time
+// next to PINGERS tasks that only yield. Without a budget the reader never
+// gives up the thread and the pingers wait for all of it; with one they get
+// a turn every ASYNC_COOP_BUDGET reads. Reports the longest time a pinger
+// waited for its turn.
+#include "../src/async.h"
+#include "../src/io.h"
+#include "bench.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef BYTES
+#define BYTES 65536
+#endif
+
+#ifndef PINGERS
+#define PINGERS 10
+#endif
+
+static volatile int done = 0;
+static double worst = 0;
+
+void pinger(void *args) {
+  double last = bench_now();
+  while (!done) {
+    async_skip();
+    double now = bench_now();
+    if (now - last > worst)
+      worst = now - last;
+    last = now;
+  }
+  async_return(NULL);
+}
+
+void reader(void *args) {
+  int fd = *(int *)args;
+  for (int i = 0; i < BYTES; i++) {
+    char c;
+    if (await_async_recv(fd, &c, 1, 0) != 1)
+      exit(1);
+  }
+  done = 1;
+  async_return(NULL);
+}
+
+void async_main(void *args) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    return perror("socketpair"), exit(1);
+  int size = 2 * BYTES;
+  setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  static char buf[BYTES];
+  if (write(fds[1], buf, BYTES) != BYTES)
+    return perror("write"), exit(1);
+
+  Handle hs[PINGERS + 1];
+  for (int i = 0; i < PINGERS; i++)
+    hs[i] = async_call(pinger, NULL);
+  hs[PINGERS] = async_call(reader, &fds[0]);
+  await_all(hs, PINGERS + 1, NULL);
+  bench_report(worst * 1e6);
+  async_return(NULL);
+}
+
+void run(void *args) {
+  RuntimeOptions opts = {.coop_budget = (int)(long)args};
+  run_async_main_ex(async_main, NULL, &opts);
+}
+
+int main(int argc, char *argv[]) {
+  printf("budget, longest wait of a pinger in us\n");
+  double off = bench_run(run, (void *)-1);
+  double on = bench_run(run, (void *)0);
+  if (off < 0 || on < 0) {
+    fprintf(stderr, "benchmark failed\n");
+    return 1;
+  }
+  printf("off, %.1f\n%d, %.1f\n", off, ASYNC_COOP_BUDGET, on);
+  return 0;
+}
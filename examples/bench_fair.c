@@ -0,0 +1,57 @@
+// A noisy tenant with NOISY tasks next to a quiet one with a single task,
+// both doing the same work per round. The round robin queue hands out the
+// CPU per task, so the quiet tenant gets 1/(NOISY+1) of it; with each in a
+// group of equal weight the fair scheduler splits it evenly.
+#include "../src/async.h"
+#include "bench.h"
+#include <stdio.h>
+
+#ifndef NOISY
+#define NOISY 100
+#endif
+
+#ifndef ROUNDS
+#define ROUNDS 200000
+#endif
+
+static long rounds[2];
+
+void tenant(void *args) {
+  long slot = (long)args;
+  while (rounds[0] + rounds[1] < ROUNDS) {
+    for (volatile int i = 0; i < 1000; i++)
+      ;
+    rounds[slot]++;
+    async_skip();
+  }
+  async_return(NULL);
+}
+
+void async_main(void *args) {
+  CallOptions noisy = {.group = async_group_create(100)};
+  CallOptions quiet = {.group = async_group_create(100)};
+  Handle hs[NOISY + 1];
+  for (int i = 0; i < NOISY; i++)
+    hs[i] = async_call_ex(tenant, (void *)0, &noisy);
+  hs[NOISY] = async_call_ex(tenant, (void *)1, &quiet);
+  await_all(hs, NOISY + 1, NULL);
+  bench_report(100.0 * rounds[1] / (rounds[0] + rounds[1]));
+  async_return(NULL);
+}
+
+void run(void *args) {
+  RuntimeOptions opts = {.scheduler = (SchedulerKind)(long)args};
+  run_async_main_ex(async_main, NULL, &opts);
+}
+
+int main(int argc, char *argv[]) {
+  printf("scheduler, %% of the CPU for the quiet tenant\n");
+  double queue = bench_run(run, (void *)SCHEDULER_QUEUE);
+  double fair = bench_run(run, (void *)SCHEDULER_FAIR);
+  if (queue < 0 || fair < 0) {
+    fprintf(stderr, "benchmark failed\n");
+    return 1;
+  }
+  printf("queue, %.1f\nfair, %.1f\n", queue, fair);
+  return 0;
+}
@@ -0,0 +1,131 @@
+// A file of FILE_MB served to a socket pair the way a static-file server
+// would, with a task on the other end reading it off: with pread and
+// await_async_send, with a FileReader and await_async_send, and with a
+// FileReader sending through sendfile, under both I/O backends. The file is
+// in the page cache after the first round, so this measures what the
+// runtime adds on top of the copies. Reports MB per second.
+#define _GNU_SOURCE
+#include "../src/async.h"
+#include "../src/io.h"
+#include "bench.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef FILE_MB
+#define FILE_MB 64
+#endif
+
+#ifndef ROUNDS
+#define ROUNDS 8
+#endif
+
+#define SIZE ((long)FILE_MB << 20)
+#define CHUNK (64 * 1024)
+
+typedef enum { PREAD, READER, SENDFILE } Mode;
+
+static int file;
+
+void drain(void *args) {
+  int fd = (int)(long)args;
+  static char buf[CHUNK];
+  long total = 0;
+  int n = 0;
+  while ((n = await_async_recv(fd, buf, sizeof(buf), 0)) > 0)
+    total += n;
+  async_return((void *)total);
+}
+
+static int send_all(int fd, char *buf, int n) {
+  for (int sent = 0; sent < n;) {
+    int status = await_async_send(fd, buf + sent, n - sent, 0);
+    if (status <= 0)
+      return -1;
+    sent += status;
+  }
+  return n;
+}
+
+static long serve(Mode mode, int sock) {
+  static char buf[CHUNK];
+  FileReader r;
+  file_reader_init(&r, file, 0);
+  long total = 0;
+  ssize_t n = 0;
+  while (true) {
+    if (mode == PREAD) {
+      n = await_async_pread(file, buf, CHUNK, total);
+    } else if (mode == READER) {
+      n = await_file_read(&r, buf, CHUNK);
+    } else {
+      n = await_file_send(&r, sock, CHUNK);
+    }
+    if (n <= 0)
+      break;
+    if (mode != SENDFILE && send_all(sock, buf, n) != n)
+      return -1;
+    total += n;
+  }
+  return n == 0 ? total : -1;
+}
+
+void async_main(void *args) {
+  Mode mode = (long)args;
+  double start = 0;
+  for (int i = 0; i <= ROUNDS; i++) {
+    // round 0 only warms the page cache
+    if (i == 1)
+      start = bench_now();
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+      return perror("socketpair"), exit(1);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    Handle h = async_call(drain, (void *)(long)fds[1]);
+    long sent = serve(mode, fds[0]);
+    async_close(fds[0]);
+    long received = (long)await(h);
+    async_close(fds[1]);
+    if (sent != SIZE || received != SIZE)
+      exit(1);
+  }
+  bench_report((double)SIZE * ROUNDS / (1 << 20) / (bench_now() - start));
+  async_return(NULL);
+}
+
+static IoBackend backend;
+
+void run(void *args) {
+  RuntimeOptions opts = {.io_backend = backend};
+  run_async_main_ex(async_main, args, &opts);
+}
+
+int main(int argc, char *argv[]) {
+  file = open(".", O_TMPFILE | O_RDWR, 0600);
+  if (file == -1)
+    return perror("open"), 1;
+  static char buf[CHUNK];
+  for (long i = 0; i < SIZE; i += CHUNK)
+    if (write(file, buf, CHUNK) != CHUNK)
+      return perror("write"), 1;
+
+  printf("mode, epoll MB/s, io_uring MB/s\n");
+  static const char *modes[] = {"pread + send", "FileReader + send",
+                                "FileReader sendfile"};
+  for (long i = 0; i < 3; i++) {
+    backend = IO_EPOLL;
+    double epoll = bench_run(run, (void *)i);
+    backend = IO_URING;
+    double uring = bench_run(run, (void *)i);
+    if (epoll < 0 || uring < 0) {
+      fprintf(stderr, "benchmark failed\n");
+      return 1;
+    }
+    printf("%s, %.0f, %.0f\n", modes[i], epoll, uring);
+  }
+  close(file);
+  return 0;
+}
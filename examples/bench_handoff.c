@@ -0,0 +1,123 @@
+// Request/response chains of nested awaits next to BYSTANDERS tasks that
+// keep yielding, and a producer/consumer pair handing control back and forth
+// with async_transfer. A finished child resumes its waiter directly, so the
+// chains do not wait behind the bystanders in the run queue.
+#include "../src/async.h"
+#include "bench.h"
+#include <stdio.h>
+
+#ifndef DEPTH
+#define DEPTH 16
+#endif
+
+#ifndef CHAINS
+#define CHAINS 20000
+#endif
+
+#ifndef BYSTANDERS
+#define BYSTANDERS 100
+#endif
+
+#ifndef TRANSFERS
+#define TRANSFERS 1000000
+#endif
+
+static volatile int done = 0;
+
+void bystander(void *args) {
+  while (!done)
+    async_skip();
+  async_return(NULL);
+}
+
+void request(void *args) {
+  long depth = (long)args;
+  if (depth == 0)
+    async_return((void *)1);
+  Handle h = async_call(request, (void *)(depth - 1));
+  long n = (long)await(h);
+  async_free(h);
+  async_return((void *)(n + 1));
+}
+
+void chains_main(void *args) {
+  long bystanders = (long)args;
+  for (long i = 0; i < bystanders; i++)
+    async_orphan(async_call(bystander, NULL));
+  double start = bench_now();
+  for (int i = 0; i < CHAINS; i++) {
+    Handle h = async_call(request, (void *)DEPTH);
+    await(h);
+    async_free(h);
+  }
+  double elapsed = bench_now() - start;
+  done = 1;
+  bench_report(elapsed / CHAINS * 1e6);
+  async_return(NULL);
+}
+
+static Handle producer_task;
+static volatile long slot = 0;
+
+void consumer(void *args) {
+  long sum = 0;
+  while (slot != -1) {
+    sum += slot;
+    async_transfer(producer_task);
+  }
+  async_return((void *)sum);
+}
+
+void transfer_main(void *args) {
+  producer_task = *(Handle *)args;
+  Handle c = async_call(consumer, NULL);
+  double start = bench_now();
+  for (long i = 0; i < TRANSFERS; i++) {
+    slot = i;
+    async_transfer(c);
+  }
+  double elapsed = bench_now() - start;
+  slot = -1;
+  async_transfer(c);
+  await(c);
+  bench_report(elapsed / (2.0 * TRANSFERS) * 1e9);
+  async_return(NULL);
+}
+
+void transfers(void *args) {
+  static Handle self;
+  self = async_call(transfer_main, &self);
+  await(self);
+  async_return(NULL);
+}
+
+static SchedulerKind scheduler;
+
+void run_chains(void *args) {
+  RuntimeOptions opts = {.scheduler = scheduler};
+  run_async_main_ex(chains_main, args, &opts);
+}
+
+void run_transfers(void *args) {
+  RuntimeOptions opts = {.scheduler = scheduler};
+  run_async_main_ex(transfers, NULL, &opts);
+}
+
+int main(int argc, char *argv[]) {
+  static const char *names[] = {"graph", "queue"};
+  printf("scheduler, us per chain of %d, us per chain with %d bystanders, "
+         "ns per transfer\n",
+         DEPTH, BYSTANDERS);
+  for (int i = 0; i < 2; i++) {
+    scheduler = i == 0 ? SCHEDULER_GRAPH : SCHEDULER_QUEUE;
+    double alone = bench_run(run_chains, (void *)0);
+    double crowded = bench_run(run_chains, (void *)BYSTANDERS);
+    double transfer = bench_run(run_transfers, NULL);
+    if (alone < 0 || crowded < 0 || transfer < 0) {
+      fprintf(stderr, "benchmark failed\n");
+      return 1;
+    }
+    printf("%s, %.2f, %.2f, %.1f\n", names[i], alone, crowded, transfer);
+  }
+  return 0;
+}
@@ -0,0 +1,49 @@
+// Cost of a child call that never blocks: await(async_call(...)) with a task,
+// stack and two switches of its own, versus await_call running it on the
+// caller's stack.
+#include "../src/async.h"
+#include "bench.h"
+#include <stdio.h>
+
+#ifndef CALLS
+#define CALLS 1000000
+#endif
+
+void add(void *args) {
+  long *pair = args;
+  async_return((void *)(pair[0] + pair[1]));
+}
+
+void async_main(void *args) {
+  long inlined = (long)args;
+  long sum = 0;
+  double start = bench_now();
+  for (long i = 0; i < CALLS; i++) {
+    long pair[2] = {sum, i};
+    if (inlined) {
+      sum = (long)await_call(add, pair);
+    } else {
+      Handle h = async_call(add, pair);
+      sum = (long)await(h);
+      async_free(h);
+    }
+  }
+  double elapsed = bench_now() - start;
+  bench_report(elapsed / CALLS * 1e9);
+  async_return(NULL);
+}
+
+void run(void *args) { run_async_main(async_main, args); }
+
+int main(int argc, char *argv[]) {
+  printf("mode, ns per call\n");
+  double task = bench_run(run, (void *)0);
+  double inlined = bench_run(run, (void *)1);
+  if (task < 0 || inlined < 0) {
+    fprintf(stderr, "benchmark failed\n");
+    return 1;
+  }
+  printf("async_call + await, %.1f\n", task);
+  printf("await_call, %.1f\n", inlined);
+  return 0;
+}
@@ -0,0 +1,116 @@
+// CLIENTS tasks doing round trips to echo tasks over socket pairs, on the
+// same thread as a task crunching numbers in KERNEL_US long stretches that
+// never yield on their own. Without preemption the reactor is only polled
+// every REACTOR_TICK_INTERVAL stretches, and every round trip waits for that
+// many of them; with it the hog is switched out, and the reactor polled, once
+// its slice is over. Reports the 99th percentile round trip.
+#include "../src/async.h"
+#include "../src/io.h"
+#include "bench.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#ifndef CLIENTS
+#define CLIENTS 8
+#endif
+
+#ifndef ROUNDS
+#define ROUNDS 20
+#endif
+
+#ifndef KERNEL_US
+#define KERNEL_US 1000
+#endif
+
+static volatile int done = 0;
+static double samples[CLIENTS * ROUNDS];
+static volatile double sink = 0;
+
+void hog(void *args) {
+  double x = 1;
+  while (!done) {
+    async_preemptible_begin();
+    double end = bench_now() + KERNEL_US * 1e-6;
+    while (bench_now() < end) {
+      for (int i = 0; i < 1000; i++)
+        x = x * 1.0000001 + 1e-9;
+    }
+    async_preemptible_end();
+    async_skip();
+  }
+  sink = x;
+  async_return(NULL);
+}
+
+void echo(void *args) {
+  int fd = (int)(long)args;
+  char c;
+  while (await_async_recv(fd, &c, 1, 0) == 1)
+    await_async_send(fd, &c, 1, 0);
+  async_return(NULL);
+}
+
+void client(void *args) {
+  long id = (long)args;
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    return perror("socketpair"), exit(1);
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(fds[1], F_SETFL, O_NONBLOCK);
+  Handle e = async_call(echo, (void *)(long)fds[1]);
+  char c = 'x';
+  for (int i = 0; i < ROUNDS; i++) {
+    double start = bench_now();
+    if (await_async_send(fds[0], &c, 1, 0) != 1 ||
+        await_async_recv(fds[0], &c, 1, 0) != 1)
+      exit(1);
+    samples[id * ROUNDS + i] = bench_now() - start;
+  }
+  shutdown(fds[0], SHUT_WR);
+  await(e);
+  async_close(fds[0]);
+  async_close(fds[1]);
+  async_return(NULL);
+}
+
+static int by_value(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+void async_main(void *args) {
+  Handle h = async_call(hog, NULL);
+  Handle clients[CLIENTS];
+  for (long i = 0; i < CLIENTS; i++)
+    clients[i] = async_call(client, (void *)i);
+  await_all(clients, CLIENTS, NULL);
+  done = 1;
+  await(h);
+  qsort(samples, CLIENTS * ROUNDS, sizeof(double), by_value);
+  bench_report(samples[CLIENTS * ROUNDS * 99 / 100] * 1e6);
+  async_return(NULL);
+}
+
+void run(void *args) {
+  RuntimeOptions opts = {.preempt_us = (long)args};
+  run_async_main_ex(async_main, NULL, &opts);
+}
+
+int main(int argc, char *argv[]) {
+  static const long slices[] = {0, 1000, 100};
+  printf("time slice us, p99 round trip us with a %d us hog\n", KERNEL_US);
+  for (int i = 0; i < 3; i++) {
+    double p99 = bench_run(run, (void *)slices[i]);
+    if (p99 < 0) {
+      fprintf(stderr, "benchmark failed\n");
+      return 1;
+    }
+    if (slices[i])
+      printf("%ld, %.1f\n", slices[i], p99);
+    else
+      printf("off, %.1f\n", p99);
+  }
+  return 0;
+}
@@ -0,0 +1,72 @@
+// Latency of a short health check task next to BULK tasks that keep
+// yielding, with the round robin queue scheduler and with the check running
+// at the top priority of the priority scheduler. In the queue it waits behind
+// every bulk task, the priority scheduler runs it right away.
+#include "../src/async.h"
+#include "bench.h"
+#include <stdio.h>
+
+#ifndef PROBES
+#define PROBES 2000
+#endif
+
+static volatile int done = 0;
+
+void bulk(void *args) {
+  while (!done)
+    async_skip();
+  async_return(NULL);
+}
+
+void probe(void *args) {
+  async_skip();
+  async_return(NULL);
+}
+
+void checks(void *args) {
+  CallOptions opts = {.priority = ASYNC_PRIORITIES - 1};
+  double total = 0;
+  for (int i = 0; i < PROBES; i++) {
+    double start = bench_now();
+    Handle h = async_call_ex(probe, NULL, &opts);
+    await(h);
+    async_free(h);
+    total += bench_now() - start;
+  }
+  done = 1;
+  bench_report(total / PROBES * 1e6);
+  async_return(NULL);
+}
+
+void async_main(void *args) {
+  long tasks = (long)args;
+  for (long i = 0; i < tasks; i++)
+    async_orphan(async_call(bulk, NULL));
+  CallOptions opts = {.priority = ASYNC_PRIORITIES - 1};
+  await(async_call_ex(checks, NULL, &opts));
+  async_return(NULL);
+}
+
+static SchedulerKind scheduler;
+
+void run(void *args) {
+  RuntimeOptions opts = {.scheduler = scheduler};
+  run_async_main_ex(async_main, args, &opts);
+}
+
+int main(int argc, char *argv[]) {
+  static const long counts[] = {10, 100, 1000};
+  printf("bulk tasks, queue us per check, priority us per check\n");
+  for (int i = 0; i < 3; i++) {
+    scheduler = SCHEDULER_QUEUE;
+    double queue = bench_run(run, (void *)counts[i]);
+    scheduler = SCHEDULER_PRIORITY;
+    double priority = bench_run(run, (void *)counts[i]);
+    if (queue < 0 || priority < 0) {
+      fprintf(stderr, "benchmark failed\n");
+      return 1;
+    }
+    printf("%ld, %.2f, %.2f\n", counts[i], queue, priority);
+  }
+  return 0;
+}
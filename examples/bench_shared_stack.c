@@ -0,0 +1,81 @@
+// Memory per idle connection: CONNECTIONS tasks that used a bit of stack
+// and now wait for something, with a private stack per task versus one
+// shared stack that tasks are copied on and off.
+#include "../src/async.h"
+#include "bench.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef CONNECTIONS
+#define CONNECTIONS 20000
+#endif
+
+// stack a connection handler has in use while it waits
+#ifndef FRAME_SIZE
+#define FRAME_SIZE 1024
+#endif
+
+#ifndef SHARED_STACK_SIZE
+#define SHARED_STACK_SIZE (256ul << 10)
+#endif
+
+static Handle gate;
+static volatile int released = 0;
+
+static long rss() {
+  long pages = 0, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (!f || fscanf(f, "%ld %ld", &pages, &resident) != 2)
+    resident = 0;
+  if (f)
+    fclose(f);
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+void wait_for_gate(void *args) {
+  while (!released)
+    async_skip();
+  async_return(NULL);
+}
+
+void connection(void *args) {
+  char frame[FRAME_SIZE];
+  memset(frame, 1, sizeof(frame));
+  await(gate);
+  async_return((void *)(long)frame[FRAME_SIZE - 1]);
+}
+
+void async_main(void *args) {
+  static Handle conns[CONNECTIONS];
+  gate = async_call(wait_for_gate, NULL);
+  long before = rss();
+  for (int i = 0; i < CONNECTIONS; i++)
+    conns[i] = async_call(connection, NULL);
+  // let every connection run up to its await
+  for (int i = 0; i < 4; i++)
+    async_skip();
+  long idle = rss();
+  released = 1;
+  await_all(conns, CONNECTIONS, NULL);
+  bench_report((double)(idle - before) / CONNECTIONS);
+  async_return(NULL);
+}
+
+void run(void *args) {
+  RuntimeOptions opts = {.shared_stack_size = (unsigned long)args};
+  run_async_main_ex(async_main, NULL, &opts);
+}
+
+int main(int argc, char *argv[]) {
+  printf("mode, stack size, bytes per idle connection\n");
+  double private = bench_run(run, (void *)0);
+  double shared = bench_run(run, (void *)SHARED_STACK_SIZE);
+  if (private < 0 || shared < 0) {
+    fprintf(stderr, "benchmark failed\n");
+    return 1;
+  }
+  printf("private, %d, %.0f\n", STACK_SIZE, private);
+  printf("shared, %lu, %.0f\n", SHARED_STACK_SIZE, shared);
+  return 0;
+}
@@ -0,0 +1,66 @@
+// Scheduler bookkeeping per task: spawning TASKS tasks, awaiting them as
+// they finish, and a spawn, await and free round trip one task at a time.
+#include "../src/async.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef TASKS
+#define TASKS 100000
+#endif
+
+typedef enum { SPAWN, FINISH, ROUND_TRIP } Phase;
+
+void child(void *args) { async_return(args); }
+
+void async_main(void *args) {
+  Phase phase = (Phase)(long)args;
+  Handle *hs = malloc(TASKS * sizeof(Handle));
+  double start = bench_now();
+  if (phase == ROUND_TRIP) {
+    for (long i = 0; i < TASKS; i++) {
+      Handle h = async_call(child, (void *)i);
+      await(h);
+      async_free(h);
+    }
+    bench_report((bench_now() - start) / TASKS * 1e9);
+    async_return(NULL);
+  }
+
+  for (long i = 0; i < TASKS; i++)
+    hs[i] = async_call(child, (void *)i);
+  double spawned = bench_now();
+  for (long i = 0; i < TASKS; i++)
+    await(hs[i]);
+  double finished = bench_now();
+  if (phase == SPAWN)
+    bench_report((spawned - start) / TASKS * 1e9);
+  else
+    bench_report((finished - spawned) / TASKS * 1e9);
+  async_return(NULL);
+}
+
+static SchedulerKind scheduler;
+
+// guard pages of 100k stacks would not fit in vm.max_map_count
+void run(void *args) {
+  RuntimeOptions opts = {.scheduler = scheduler, .no_stack_guard = true};
+  run_async_main_ex(async_main, args, &opts);
+}
+
+int main(int argc, char *argv[]) {
+  static const char *names[] = {"graph", "queue"};
+  printf("scheduler, spawn ns, await and finish ns, round trip ns\n");
+  for (int i = 0; i < 2; i++) {
+    scheduler = i == 0 ? SCHEDULER_GRAPH : SCHEDULER_QUEUE;
+    double spawn = bench_run(run, (void *)SPAWN);
+    double finish = bench_run(run, (void *)FINISH);
+    double round_trip = bench_run(run, (void *)ROUND_TRIP);
+    if (spawn < 0 || finish < 0 || round_trip < 0) {
+      fprintf(stderr, "benchmark failed\n");
+      return 1;
+    }
+    printf("%s, %.0f, %.0f, %.0f\n", names[i], spawn, finish, round_trip);
+  }
+  return 0;
+}
@@ -0,0 +1,102 @@
+// TASKS tasks that each wait once and then return, written as stackless
+// PtFunctions versus plain stackful tasks: resident memory per waiting task
+// and time to spawn, run and await all of them.
+#include "../src/async.h"
+#include "../src/pt.h"
+#include "bench.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifndef TASKS
+#define TASKS 100000
+#endif
+
+static volatile int released = 0;
+
+typedef struct {
+  bool stackless;
+  bool time; // report ns per task instead of bytes
+} Mode;
+
+static long rss() {
+  long pages = 0, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (!f || fscanf(f, "%ld %ld", &pages, &resident) != 2)
+    resident = 0;
+  if (f)
+    fclose(f);
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+typedef struct {
+  Pt pt;
+  long n;
+} Waiter;
+
+PtStatus stackless_waiter(Pt *pt) {
+  Waiter *w = (Waiter *)pt;
+  PT_BEGIN(pt);
+  while (!released)
+    PT_YIELD(pt);
+  PT_RETURN(pt, w->n);
+  PT_END(pt);
+}
+
+void stackful_waiter(void *args) {
+  while (!released)
+    async_skip();
+  async_return(args);
+}
+
+void async_main(void *args) {
+  Mode *mode = args;
+  bool stackless = mode->stackless;
+  Handle *hs = malloc(TASKS * sizeof(Handle));
+  Waiter *ws = stackless ? malloc(TASKS * sizeof(Waiter)) : NULL;
+  long before = rss();
+  double start = bench_now();
+  for (long i = 0; i < TASKS; i++) {
+    if (stackless) {
+      ws[i].n = i;
+      hs[i] = async_call_pt(stackless_waiter, &ws[i].pt);
+    } else {
+      hs[i] = async_call(stackful_waiter, (void *)i);
+    }
+  }
+  // every task runs up to its wait
+  async_skip();
+  long waiting = rss();
+  released = 1;
+  await_all(hs, TASKS, NULL);
+  double elapsed = bench_now() - start;
+  if (mode->time)
+    bench_report(elapsed / TASKS * 1e9);
+  else
+    bench_report((double)(waiting - before) / TASKS);
+  async_return(NULL);
+}
+
+// guard pages of 100k stacks would not fit in vm.max_map_count
+void run(void *args) {
+  RuntimeOptions opts = {.no_stack_guard = true};
+  run_async_main_ex(async_main, args, &opts);
+}
+
+int main(int argc, char *argv[]) {
+  printf("kind, bytes per waiting task, ns per task\n");
+  Mode modes[4] = {{false, false}, {true, false}, {false, true}, {true, true}};
+  double stackful_mem = bench_run(run, &modes[0]);
+  double stackless_mem = bench_run(run, &modes[1]);
+  double stackful_ns = bench_run(run, &modes[2]);
+  double stackless_ns = bench_run(run, &modes[3]);
+  if (stackful_mem < 0 || stackless_mem < 0 || stackful_ns < 0 ||
+      stackless_ns < 0) {
+    fprintf(stderr, "benchmark failed\n");
+    return 1;
+  }
+  printf("stackful, %.0f, %.0f\n", stackful_mem, stackful_ns);
+  printf("stackless, %.0f, %.0f\n", stackless_mem, stackless_ns);
+  return 0;
+}
@@ -0,0 +1,65 @@
+// Scaling of the work stealing scheduler: TASKS cpu bound tasks that yield
+// every YIELD_EVERY iterations, run on 1, 2, 4 and 8 worker threads.
+#include "../src/async.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef TASKS
+#define TASKS 256
+#endif
+
+#ifndef ITERS
+#define ITERS 2000000
+#endif
+
+#ifndef YIELD_EVERY
+#define YIELD_EVERY 10000
+#endif
+
+void crunch(void *args) {
+  unsigned long x = (unsigned long)args + 1;
+  for (long i = 0; i < ITERS; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    if (i % YIELD_EVERY == 0)
+      async_skip();
+  }
+  async_return((void *)x);
+}
+
+void async_main(void *args) {
+  static Handle tasks[TASKS];
+  double start = bench_now();
+  for (long i = 0; i < TASKS; i++)
+    tasks[i] = async_call(crunch, (void *)i);
+  await_all(tasks, TASKS, NULL);
+  bench_report(bench_now() - start);
+  async_return(NULL);
+}
+
+void run(void *args) {
+  RuntimeOptions opts = {
+      .scheduler = SCHEDULER_STEAL,
+      .threads = (int)(long)args,
+  };
+  run_async_main_ex(async_main, NULL, &opts);
+}
+
+int main(int argc, char *argv[]) {
+  int threads[] = {1, 2, 4, 8};
+  double base = 0;
+  printf("threads, seconds, speedup\n");
+  for (int i = 0; i < 4; i++) {
+    double secs = bench_run(run, (void *)(long)threads[i]);
+    if (secs < 0) {
+      fprintf(stderr, "run with %d threads failed\n", threads[i]);
+      return 1;
+    }
+    if (i == 0)
+      base = secs;
+    printf("%d, %.3f, %.2f\n", threads[i], secs, base / secs);
+  }
+  return 0;
+}
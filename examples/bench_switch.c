@@ -0,0 +1,62 @@
+// Switch throughput with many live tasks, stacks on 4KB pages versus 2MB
+// huge pages. Every switch touches the top of another task's stack, so with
+// enough tasks the small-page runs are bound by dTLB misses. Guard pages are
+// off in both runs: they cost two mappings per stack and 100k tasks would
+// not fit in vm.max_map_count.
+#include "../src/async.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// switches per run, split over the tasks
+#ifndef SWITCHES
+#define SWITCHES 4000000
+#endif
+
+static int rounds;
+
+void spinner(void *args) {
+  for (int i = 0; i < rounds; i++)
+    async_skip();
+  async_return(NULL);
+}
+
+void async_main(void *args) {
+  long tasks = (long)args;
+  rounds = SWITCHES / tasks;
+  Handle *all = malloc(tasks * sizeof(Handle));
+  for (long i = 0; i < tasks; i++)
+    all[i] = async_call(spinner, NULL);
+  // first round faults the stacks in
+  async_skip();
+  double start = bench_now();
+  await_all(all, tasks, NULL);
+  double elapsed = bench_now() - start;
+  free(all);
+  bench_report((double)tasks * (rounds - 1) / elapsed / 1e6);
+  async_return(NULL);
+}
+
+static long tasks;
+
+void run(void *args) {
+  RuntimeOptions opts = {.no_stack_guard = true,
+                         .stack_huge_pages = (long)args};
+  run_async_main_ex(async_main, (void *)tasks, &opts);
+}
+
+int main(int argc, char *argv[]) {
+  static const long counts[] = {1000, 10000, 100000};
+  printf("tasks, 4KB pages M switches/s, huge pages M switches/s\n");
+  for (int i = 0; i < 3; i++) {
+    tasks = counts[i];
+    double small = bench_run(run, (void *)0);
+    double huge = bench_run(run, (void *)1);
+    if (small < 0 || huge < 0) {
+      fprintf(stderr, "benchmark failed\n");
+      return 1;
+    }
+    printf("%ld, %.1f, %.1f\n", tasks, small, huge);
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+// Walks over the task table with TASKS live tasks: await_all polling that
+// many finished handles, and round robin async_skip through all of them.
+#include "../src/async.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef TASKS
+#define TASKS 100000
+#endif
+
+#ifndef ROUNDS
+#define ROUNDS 20
+#endif
+
+static volatile int stop = 0;
+
+void finished(void *args) { async_return(args); }
+
+void spinner(void *args) {
+  for (int i = 0; i < ROUNDS; i++)
+    async_skip();
+  async_return(NULL);
+}
+
+void await_all_main(void *args) {
+  Handle *hs = malloc(TASKS * sizeof(Handle));
+  for (long i = 0; i < TASKS; i++)
+    hs[i] = async_call(finished, (void *)i);
+  await_all(hs, TASKS, NULL);
+  double start = bench_now();
+  for (int i = 0; i < ROUNDS; i++)
+    await_all(hs, TASKS, NULL);
+  bench_report((bench_now() - start) / ROUNDS / TASKS * 1e9);
+  async_return(NULL);
+}
+
+void skip_main(void *args) {
+  Handle *hs = malloc(TASKS * sizeof(Handle));
+  for (long i = 0; i < TASKS; i++)
+    hs[i] = async_call(spinner, NULL);
+  double start = bench_now();
+  await_all(hs, TASKS, NULL);
+  bench_report((bench_now() - start) / ROUNDS / TASKS * 1e9);
+  async_return(NULL);
+}
+
+static SchedulerKind scheduler;
+
+// guard pages of 100k stacks would not fit in vm.max_map_count
+void run(void *args) {
+  RuntimeOptions opts = {.scheduler = scheduler, .no_stack_guard = true};
+  run_async_main_ex((AsyncFunction *)args, NULL, &opts);
+}
+
+int main(int argc, char *argv[]) {
+  static const char *names[] = {"graph", "queue"};
+  printf("scheduler, await_all ns per handle, async_skip ns per switch\n");
+  for (int i = 0; i < 2; i++) {
+    scheduler = i == 0 ? SCHEDULER_GRAPH : SCHEDULER_QUEUE;
+    double poll = bench_run(run, await_all_main);
+    double skip = bench_run(run, skip_main);
+    if (poll < 0 || skip < 0) {
+      fprintf(stderr, "benchmark failed\n");
+      return 1;
+    }
+    printf("%s, %.1f, %.1f\n", names[i], poll, skip);
+  }
+  return 0;
+}
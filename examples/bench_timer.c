@@ -0,0 +1,119 @@
+// Tasks that keep waiting with a timeout of PERIOD_MS to 2 * PERIOD_MS that
+// always runs out: sleepers in async_sleep_ns, and idle connections in
+// await_async_recv_timeout on socket pairs nobody writes to. Timers live in
+// a timing wheel the reactor advances when it polls, so CPU time per expired
+// timeout should stay flat however many are running. Reports CPU ns per
+// expired timeout.
+#include "../src/async.h"
+#include "../src/io.h"
+#include "bench.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef PERIOD_MS
+#define PERIOD_MS 20
+#endif
+
+#ifndef RUN_MS
+#define RUN_MS 500
+#endif
+
+#define MS 1000000L
+
+static volatile int done = 0;
+static long expired = 0;
+
+static long timeout_of(long i) { return PERIOD_MS * MS * (16 + i % 16) / 16; }
+
+void sleeper(void *args) {
+  long timeout = timeout_of((long)args);
+  while (!done) {
+    async_sleep_ns(timeout);
+    expired++;
+  }
+  async_return(NULL);
+}
+
+void idle(void *args) {
+  long i = (long)args;
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    return perror("socketpair"), exit(1);
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  char c;
+  while (!done) {
+    if (await_async_recv_timeout(fds[0], &c, 1, 0, timeout_of(i)) != -1 ||
+        errno != ETIMEDOUT)
+      exit(1);
+    expired++;
+  }
+  async_close(fds[0]);
+  close(fds[1]);
+  async_return(NULL);
+}
+
+static double cpu_now() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec +
+         ru.ru_stime.tv_usec * 1e-6;
+}
+
+static AsyncFunction *waiter;
+
+void async_main(void *args) {
+  long n = (long)args;
+  CallOptions small = {.stack_size = 8192};
+  Handle *all = malloc(n * sizeof(Handle));
+  for (long i = 0; i < n; i++)
+    all[i] = async_call_ex(waiter, (void *)i, &small);
+  // let every waiter get its first timer going
+  async_sleep_ns(PERIOD_MS * MS);
+  long before = expired;
+  double start = cpu_now();
+  async_sleep_ns(RUN_MS * MS);
+  double cpu = cpu_now() - start;
+  long count = expired - before;
+  done = 1;
+  await_all(all, n, NULL);
+  free(all);
+  bench_report(cpu / count * 1e9);
+  async_return(NULL);
+}
+
+void run(void *args) {
+  // 100k guard pages would not fit in vm.max_map_count
+  RuntimeOptions opts = {.no_stack_guard = true};
+  run_async_main_ex(async_main, args, &opts);
+}
+
+int main(int argc, char *argv[]) {
+  static const long counts[] = {100, 1000, 10000, 100000};
+  printf("waiters, sleepers CPU ns per timeout, idle connections CPU ns per "
+         "timeout\n");
+  for (int i = 0; i < 4; i++) {
+    waiter = sleeper;
+    double sleeping = bench_run(run, (void *)counts[i]);
+    // two fds per connection
+    double connections = 0;
+    if (counts[i] * 2 + 64 < sysconf(_SC_OPEN_MAX)) {
+      waiter = idle;
+      connections = bench_run(run, (void *)counts[i]);
+    }
+    if (sleeping < 0 || connections < 0) {
+      fprintf(stderr, "benchmark failed\n");
+      return 1;
+    }
+    if (connections) {
+      printf("%ld, %.0f, %.0f\n", counts[i], sleeping, connections);
+    } else {
+      printf("%ld, %.0f, -\n", counts[i], sleeping);
+    }
+  }
+  return 0;
+}
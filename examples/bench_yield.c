@@ -0,0 +1,56 @@
+// Cost of async_skip between two tasks, the shortest path through the
+// scheduler. Built with `make SCHEDULER=<kind>` only the bound scheduler runs,
+// with its calls direct instead of through the vtable.
+#include "../src/async.h"
+#include "bench.h"
+#include <stdio.h>
+
+#ifndef YIELDS
+#define YIELDS 4000000
+#endif
+
+void spinner(void *args) {
+  for (long i = 0; i < YIELDS; i++)
+    async_skip();
+  async_return(NULL);
+}
+
+void async_main(void *args) {
+  Handle other = async_call(spinner, NULL);
+  double start = bench_now();
+  for (long i = 0; i < YIELDS; i++)
+    async_skip();
+  double elapsed = bench_now() - start;
+  await(other);
+  bench_report(elapsed / (2.0 * YIELDS) * 1e9);
+  async_return(NULL);
+}
+
+void run(void *args) {
+  RuntimeOptions opts = {.scheduler = (SchedulerKind)(long)args, .threads = 1};
+  run_async_main_ex(async_main, NULL, &opts);
+}
+
+#define STR(x) #x
+#define NAME(x) STR(x)
+
+int main(int argc, char *argv[]) {
+  static const char *names[] = {"graph", "queue", "steal", "priority", "fair"};
+  printf("scheduler, ns per yield\n");
+  for (long kind = SCHEDULER_GRAPH; kind <= SCHEDULER_FAIR; kind++) {
+    const char *name = names[kind];
+#ifdef ASYNC_SCHEDULER
+    // every kind would run the bound scheduler
+    if (kind != SCHEDULER_GRAPH)
+      break;
+    name = NAME(ASYNC_SCHEDULER) " (bound)";
+#endif
+    double ns = bench_run(run, (void *)kind);
+    if (ns < 0) {
+      fprintf(stderr, "benchmark failed\n");
+      return 1;
+    }
+    printf("%s, %.1f\n", name, ns);
+  }
+  return 0;
+}
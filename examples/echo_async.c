@@ -32,10 +32,6 @@
 #define BUF_SIZE 256
 #endif
 
-#ifndef SLEEP_TIME
-#define SLEEP_TIME 10000
-#endif
-
 static int current_client_cnt = 0;
 static int bytes_processed = 0;
 
@@ -94,7 +90,7 @@ void echo_loop(void *args) {
   String msg;
   string_init(&msg);
   bool running = true;
-  current_client_cnt++;
+  __atomic_fetch_add(&current_client_cnt, 1, __ATOMIC_RELAXED);
 
   while (running) {
     char size[4] = {0};
@@ -104,7 +100,7 @@ void echo_loop(void *args) {
 
     int msg_len = ntohl(*(uint32_t *)size);
     LOG("message length: %d", msg_len);
-    bytes_processed += msg_len + 4;
+    __atomic_fetch_add(&bytes_processed, msg_len + 4, __ATOMIC_RELAXED);
     string_clear(&msg);
     string_resize(&msg, msg_len, '!');
     if (read_n_bytes(client_socket, msg_len, msg.str, &buf) != msg_len) {
@@ -122,11 +118,11 @@ void echo_loop(void *args) {
 fail:
   LOG("%s", "Client left");
 
-  current_client_cnt--;
+  __atomic_fetch_sub(&current_client_cnt, 1, __ATOMIC_RELAXED);
 
   string_deinit(&msg);
   shutdown(client_socket, SHUT_RDWR);
-  close(client_socket);
+  async_close(client_socket);
   async_return(NULL);
 }
 
@@ -156,39 +152,44 @@ void accept_loop(void *args) {
 
 void server_stats(void *args) {
   long server_start_time = time(NULL);
-  long last_message_time = server_start_time;
 
   while (true) {
+    async_sleep_ns(1000000000L);
     long current_time = time(NULL);
-    if (current_time - last_message_time >= 1) {
-      fprintf(stdout, "%ld, %d, %d\n", current_time - server_start_time,
-              current_client_cnt, bytes_processed);
-      fflush(stdout);
-      bytes_processed = 0;
-      last_message_time = current_time;
-    }
-    struct timespec sleep_delay = {
-        .tv_sec = 0,
-        .tv_nsec = SLEEP_TIME,
-    };
-    if (nanosleep(&sleep_delay, NULL) < 0) {
-      perror("nanosleep:");
-    }
-    async_skip();
+    fprintf(stdout, "%ld, %d, %d\n", current_time - server_start_time,
+            __atomic_load_n(&current_client_cnt, __ATOMIC_RELAXED),
+            __atomic_exchange_n(&bytes_processed, 0, __ATOMIC_RELAXED));
+    fflush(stdout);
   }
   async_return(NULL);
 }
 
-void async_main(void *args) {
+typedef struct {
+  const char *port;
+  struct addrinfo *info;
+} Resolve;
+
+// getaddrinfo may have to ask the network, so it runs on the blocking pool
+void *resolve(void *args) {
+  Resolve *r = args;
   struct addrinfo hints = {0};
-  const char *port = args;
   hints.ai_family = AF_UNSPEC;
   hints.ai_socktype = SOCK_STREAM;
   hints.ai_flags = AI_PASSIVE;
+  return (void *)(long)getaddrinfo(NULL, r->port, &hints, &r->info);
+}
 
-  struct addrinfo *server_info = NULL;
-
-  int gai_status = getaddrinfo(NULL, port, &hints, &server_info);
+void async_main(void *args) {
+  const char *port = args;
+  // off the stack, which may be shared while the pool thread writes to it
+  Resolve *r = calloc(1, sizeof(Resolve));
+  assert(r);
+  r->port = port;
+  Handle h = async_spawn_blocking(resolve, r);
+  int gai_status = (int)(long)await(h);
+  async_free(h);
+  struct addrinfo *server_info = r->info;
+  free(r);
   if (gai_status != 0) {
     LOG("getaddrinfo: %s", gai_strerror(gai_status));
     exit(1);
@@ -200,6 +201,12 @@ void async_main(void *args) {
         socket(info->ai_family, info->ai_socktype, info->ai_protocol);
     if (accept_socket == -1)
       continue;
+    // every shard binds its own listener, the kernel spreads the connections
+    int reuse = 1;
+    if (setsockopt(accept_socket, SOL_SOCKET, SO_REUSEPORT, &reuse,
+                   sizeof(reuse)) == -1) {
+      perror("setsockopt");
+    }
 
     if (bind(accept_socket, info->ai_addr, info->ai_addrlen) == 0) {
       LOG("%s", "Server running on");
@@ -230,15 +237,38 @@ void async_main(void *args) {
     perror("fcntl");
     exit(1);
   }
-  async_orphan(async_call(server_stats, NULL));
+  if (async_shard_id() == 0)
+    async_orphan(async_call(server_stats, NULL));
   await(async_call(accept_loop, &accept_socket));
 
   shutdown(accept_socket, SHUT_RDWR);
-  close(accept_socket);
+  async_close(accept_socket);
 
   async_return(NULL);
 }
 
 int main(int argc, char *argv[]) {
-  run_async_main(async_main, (argc == 1 ? "8080" : argv[1]));
+  const char *port = "8080";
+  RuntimeOptions opts = {0};
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+      i++;
+      if (strcmp(argv[i], "uring") == 0) {
+        opts.io_backend = IO_URING;
+      } else if (strcmp(argv[i], "epoll") == 0) {
+        opts.io_backend = IO_EPOLL;
+      } else {
+        fprintf(stderr, "unknown io backend: %s\n", argv[i]);
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      opts.scheduler = SCHEDULER_STEAL;
+      opts.threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+      opts.shards = atoi(argv[++i]);
+    } else {
+      port = argv[i];
+    }
+  }
+  run_async_main_ex(async_main, (void *)port, &opts);
 }
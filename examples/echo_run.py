@@ -4,6 +4,7 @@ import time
 import asyncio
 import random
 import argparse
+import shlex
 
 async def run_watch(name, server_pid):
     s = ""
@@ -66,7 +67,7 @@ async def run_server_listener(reader, writer, server, port, out, name, serv):
     await writer.drain()
 
     server_proc = await asyncio.subprocess.create_subprocess_exec(
-        server, str(port), stdout=asyncio.subprocess.PIPE,
+        *shlex.split(server), str(port), stdout=asyncio.subprocess.PIPE,
     )
     watch_task = asyncio.create_task(run_watch(name, server_proc.pid))
     server_task = asyncio.create_task(server_proc.wait())
@@ -129,7 +130,7 @@ async def main(args):
 
     if "all" in args.tests or "throughput" in args.tests:
         await run_instance(
-                "./build/examples/echo_async", 
+                f"./build/examples/echo_async {args.async_args}",
                 "./examples/echo_client_throughput.py", 
                  f"{args.prefix}-async-throughput", args,
         )
@@ -145,7 +146,7 @@ async def main(args):
         )
     if "all" in args.tests or "stress" in args.tests:
         await run_instance(
-                "./build/examples/echo_async", 
+                f"./build/examples/echo_async {args.async_args}",
                 "./examples/echo_client_stress.py", 
                  f"{args.prefix}-async-stress", args,
         )
@@ -167,6 +168,7 @@ parser.add_argument("--port", default="6969")
 parser.add_argument("--tests", nargs="+", default="all", choices=["all", "stress", "throughput"])
 parser.add_argument("--prefix", default="local")
 parser.add_argument("--out", default="echo-out")
+parser.add_argument("--async-args", default="", help="extra echo_async flags, e.g. '--shards 4'")
 args = parser.parse_args(sys.argv[1:])
 
 asyncio.run(main(args))
@@ -1,106 +1,318 @@
+#define _GNU_SOURCE
 #include "async.h"
 #include "dbg.h"
 #include "scheduler.h"
 #include "switch.h"
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <setjmp.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <sys/mman.h>
 
-void async_free(Handle h) { free_task(h); }
+// Every entry point takes the runtime lock, which is a no-op unless the
+// scheduler runs tasks on several threads. A task that switches away leaves
+// the lock to the task it resumes.
+
+void async_free(Handle h) {
+  runtime_lock();
+  free_task(h);
+  runtime_unlock();
+}
 
 void async_orphan(Handle h) {
+  runtime_lock();
   Task *t = get_task(h);
   t->orphaned = true;
+  runtime_unlock();
 }
 
 Handle async_call(AsyncFunction *f, void *arg) {
-  Handle h = start_new_task(f, arg);
+  return async_call_ex(f, arg, NULL);
+}
+
+Handle async_call_ex(AsyncFunction *f, void *arg, const CallOptions *opts) {
+  runtime_lock();
+  Handle h = start_new_task(f, arg, opts);
+  runtime_unlock();
   DBG("new coroutine: %d", h.idx);
   return h;
 }
 
 void run_async_main(AsyncFunction *main_fn, void *arg) {
-  async_init();
-  Handle h = async_call(main_fn, arg);
-  assert(h.idx == 1);
-  async_switch((Handle){.idx = 0}, h);
-  assert(false);
+  RuntimeOptions opts = {0};
+  run_async_main_ex(main_fn, arg, &opts);
+}
+
+typedef struct {
+  AsyncFunction *main_fn;
+  void *arg;
+  RuntimeOptions opts;
+  int shard;
+} Shard;
+
+// Pins the calling thread to the shard-th cpu it is allowed to run on.
+static void pin_to_cpu(int shard) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+    return;
+  int n = shard % CPU_COUNT(&allowed);
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed) && n-- == 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      return;
+    }
+  }
+}
+
+static void *shard_main(void *args) {
+  Shard *s = args;
+  Runtime *rt = calloc(1, sizeof(Runtime));
+  assert(rt);
+  rt->shard = s->shard;
+  set_current_runtime(rt);
+  pin_to_cpu(s->shard);
+
+  async_init(&s->opts);
+  runtime_lock();
+  Handle h = start_new_task(s->main_fn, s->arg, NULL);
+  rt->pool.main_task = h;
+  async_switch_from_native(&rt->native_stack_ptr, wait_runnable_task());
+
+  // main task of the shard returned
+  async_deinit();
+  free(rt);
+  free(s);
+  return NULL;
+}
+
+void run_async_main_ex(AsyncFunction *main_fn, void *arg,
+                       const RuntimeOptions *opts) {
+  if (opts->shards > 1) {
+    SchedulerKind kind = opts->scheduler;
+#ifdef ASYNC_SCHEDULER
+    kind = SCHED_FN(ASYNC_SCHEDULER, scheduler_kind);
+#endif
+    assert(kind != SCHEDULER_STEAL &&
+           "shards run a single threaded scheduler each");
+    for (int i = 1; i < opts->shards; i++) {
+      Shard *s = malloc(sizeof(Shard));
+      assert(s);
+      *s = (Shard){.main_fn = main_fn, .arg = arg, .opts = *opts, .shard = i};
+      pthread_t thread;
+      if (pthread_create(&thread, NULL, shard_main, s) != 0) {
+        perror("pthread_create");
+        exit(1);
+      }
+      pthread_detach(thread);
+    }
+    pin_to_cpu(0);
+  }
+
+  async_init(opts);
+  runtime_lock();
+  Runtime *rt = current_runtime();
+  rt->pool.main_task = start_new_task(main_fn, arg, NULL);
+  async_switch_from_native(&rt->native_stack_ptr, wait_runnable_task());
+
+  // main task returned, its stack can go now
+  int exit_code = rt->exit_code;
+  async_deinit();
+  exit(exit_code);
+}
+
+int async_shard_id() { return current_runtime()->shard; }
+
+int async_stack_stats(AsyncStackStats *out, int cap) {
+  runtime_lock();
+  StackProfile *p = &global_pool()->profile;
+  int len = 0;
+  for (uint64_t cell = 0; cell < p->fns.cap; cell++) {
+    for (HashNode *n = p->fns.cells[cell]; n; n = n->next, len++) {
+      if (len >= cap)
+        continue;
+      StackUse *u = (StackUse *)n->val;
+      out[len] = (AsyncStackStats){
+          .fn = (AsyncFunction *)n->key,
+          .peak = u->peak,
+          .tasks = u->tasks,
+          .stack_size = stack_profile_size(p, (void *)n->key),
+      };
+    }
+  }
+  runtime_unlock();
+  return len;
 }
 
 void *await(Handle h) {
+  runtime_lock();
   wait_ready(h);
   Task *t = get_task(h);
-  return t->data;
+  void *data = t->data;
+  coop_charge();
+  runtime_unlock();
+  return data;
+}
+
+void *await_call(AsyncFunction *f, void *arg) {
+  runtime_lock();
+  Handle current = current_task_handle();
+  InlineCall call = {.prev = get_task(current)->inline_call};
+  get_task(current)->inline_call = &call;
+  runtime_unlock();
+  if (_setjmp(call.env) == 0) {
+    f(arg);
+    assert(false && "async functions end with async_return");
+  }
+  return call.result;
 }
 
 void async_return(void *data) {
+  runtime_lock();
   Handle finished_task = current_task_handle();
-  if (finished_task.idx == 1) {
-    async_deinit();
-    exit((int)(long)data);
+  InlineCall *call = get_task(finished_task)->inline_call;
+  if (call) {
+    get_task(finished_task)->inline_call = call->prev;
+    call->result = data;
+    runtime_unlock();
+    _longjmp(call->env, 1);
+  }
+  measure_stack(finished_task);
+  if (finished_task.idx == global_pool()->main_task.idx) {
+    Runtime *rt = current_runtime();
+    // other workers may still run tasks on their stacks, leave them be
+    if (rt->scheduler.lock)
+      exit((int)(long)data);
+    rt->exit_code = (int)(long)data;
+    async_switch_native(rt->native_stack_ptr);
   }
-  Handle next_task = {0};
+  // a task awaiting only this one runs next, without a trip through the queue
+  Handle next_task = take_sole_waiter(finished_task);
   finish_current_task(&finished_task, &next_task);
   DBG("%d finished with %p", finished_task.idx, data);
-  if (finished_task.idx == 1) {
-    exit((int)(long)data);
-  }
   Task *t = get_task(finished_task);
   t->data = data;
-  t->state = READY;
+  get_hot(finished_task)->state = READY;
+  wake_waiters(finished_task);
   if (t->orphaned) {
-    async_free(finished_task);
+    free_task(finished_task);
   }
+  if (next_task.idx == 0)
+    next_task = wait_runnable_task();
   async_switch((Handle){0}, next_task);
   assert(false);
 }
 
 void async_skip() {
+  runtime_lock();
   Handle current = current_task_handle();
   Handle next = next_task_handle();
-  Task *t1 = get_task(current);
 
   if (current.idx != next.idx)
     async_switch(current, next);
+  runtime_unlock();
+}
+
+void async_sleep_ns(long ns) {
+  runtime_lock();
+  timer_start(timer_deadline(ns < 0 ? 0 : ns), NULL, 0);
+  park_current_task();
+  timer_stop();
+  runtime_unlock();
+}
+
+bool await_timeout(Handle h, long timeout_ns, void **result) {
+  runtime_lock();
+  if (poll_state(h) != READY)
+    wait_tasks_until(&h, 1, 1, timer_deadline(timeout_ns < 0 ? 0 : timeout_ns));
+  bool done = poll_state(h) == READY;
+  if (done && result)
+    *result = get_task(h)->data;
+  coop_charge();
+  runtime_unlock();
+  return done;
+}
+
+void async_set_priority(Handle h, int priority) {
+  runtime_lock();
+  set_task_priority(h, priority);
+  runtime_unlock();
+}
+
+int async_group_create(unsigned weight) {
+  runtime_lock();
+  int group = create_group(weight);
+  runtime_unlock();
+  return group;
+}
+
+void async_group_set_cap(int group, int percent) {
+  runtime_lock();
+  set_group_cap(group, percent);
+  runtime_unlock();
+}
+
+void async_preemptible_begin() {
+  runtime_lock();
+  preempt_begin();
+  runtime_unlock();
+}
+
+void async_preemptible_end() {
+  runtime_lock();
+  preempt_end();
+  runtime_unlock();
+}
+
+void async_transfer(Handle h) {
+  runtime_lock();
+  transfer_current_task(h);
+  runtime_unlock();
 }
 
 void *await_any(Handle *handles, int len, int *result_idx) {
-  while (true) {
-    for (int i = 0; i < len; i++) {
-      Handle h = handles[i];
-      assert(h.idx != 0);
-      if (poll_state(h) == READY) {
-        Task *t = get_task(h);
-        if (result_idx)
-          *result_idx = i;
-        return t->data;
-      }
-    }
-    async_skip();
+  runtime_lock();
+  int idx = -1;
+  for (int i = 0; i < len && idx == -1; i++) {
+    assert(handles[i].idx != 0);
+    if (poll_state(handles[i]) == READY)
+      idx = i;
   }
+  if (idx == -1)
+    idx = wait_tasks(handles, len, 1);
+
+  if (result_idx)
+    *result_idx = idx;
+  void *data = get_task(handles[idx])->data;
+  coop_charge();
+  runtime_unlock();
+  return data;
 }
 
 void await_all(Handle *handles, int len, void **results) {
-  while (true) {
-    int succ_cnt = 0;
-    for (int i = 0; i < len; i++) {
-      Handle h = handles[i];
-      assert(h.idx != 0);
-      if (poll_state(h) == READY) {
-        Task *t = get_task(h);
-        if (results)
-          results[i] = t->data;
-        succ_cnt++;
-      }
-    }
-    DBG("succ_cnt=%d", succ_cnt);
+  runtime_lock();
+  int running = 0;
+  for (int i = 0; i < len; i++) {
+    assert(handles[i].idx != 0);
+    if (poll_state(handles[i]) != READY)
+      running++;
+  }
+  DBG("running=%d", running);
+  if (running)
+    wait_tasks(handles, len, running);
 
-    if (succ_cnt == len)
-      break;
-    async_skip();
+  if (results) {
+    for (int i = 0; i < len; i++)
+      results[i] = get_task(handles[i])->data;
   }
+  coop_charge();
+  runtime_unlock();
 }
@@ -1,22 +1,156 @@
 #ifndef __ASYNC_H__
 #define __ASYNC_H__
 
+#include <stdbool.h>
+
 #define STACK_SIZE 16384
 
+// Levels of SCHEDULER_PRIORITY, 0 is the default and the lowest
+#ifndef ASYNC_PRIORITIES
+#define ASYNC_PRIORITIES 4
+#endif
+
+#ifndef ASYNC_COOP_BUDGET
+#define ASYNC_COOP_BUDGET 128
+#endif
+
+// OS threads async_spawn_blocking runs calls on, shared by all runtimes
+#ifndef ASYNC_BLOCKING_THREADS
+#define ASYNC_BLOCKING_THREADS 16
+#endif
+
+// Weight of group 0, which the main task and everything not put in a group
+// runs in
+#define ASYNC_GROUP_DEFAULT_WEIGHT 100
+
 typedef struct {
   int idx;
+  unsigned gen; // the slot's generation, handles of freed tasks go stale
 } Handle;
 
 typedef void AsyncFunction(void *);
+typedef void *BlockingFunction(void *);
+
+typedef enum {
+  IO_EPOLL, // retry the syscall once epoll says the fd is ready
+  IO_URING, // io_uring completions, falls back to IO_EPOLL if unavailable
+} IoBackend;
+
+typedef enum {
+  SCHEDULER_GRAPH, // single threaded, default
+  SCHEDULER_QUEUE, // single threaded round robin
+  SCHEDULER_STEAL, // M:N, worker threads stealing tasks from each other
+  // single threaded, always runs a task of the highest priority that has any
+  // ready, round robin within a level
+  SCHEDULER_PRIORITY,
+  // single threaded, shares the CPU between task groups by weight
+  SCHEDULER_FAIR,
+} SchedulerKind;
+
+typedef struct {
+  IoBackend io_backend;
+  SchedulerKind scheduler;
+  int threads; // workers of SCHEDULER_STEAL, 0 means one per core
+  // Independent runtimes, one per thread pinned to its own core, all running
+  // main_fn. Tasks never leave their shard. The process exits when the main
+  // task of shard 0 returns.
+  int shards;
+  // bytes of finished tasks' stacks kept resident for reuse, 0 means
+  // STACK_WARM_POOL; the rest are released with MADV_DONTNEED
+  unsigned long stack_warm_pool;
+  bool no_stack_guard; // skip the PROT_NONE page below every stack
+  // Carve stacks out of 2MB huge pages, fewer dTLB misses when switching
+  // between many tasks. Uses MAP_HUGETLB if vm.nr_hugepages has pages
+  // reserved and transparent huge pages otherwise. Implies no_stack_guard,
+  // and stacks of finished tasks are never given back to the kernel.
+  bool stack_huge_pages;
+  // Run every task on one stack of this size and copy the used part of it
+  // in and out on each switch, 0 gives every task a stack of its own. Tasks
+  // must not hand pointers to their stack to other tasks in this mode.
+  unsigned long shared_stack_size;
+  // Paint stacks and record how deep tasks of every function go, see
+  // async_stack_stats. Costs a memset of the whole stack per task.
+  bool stack_stats;
+  // Implies stack_stats. Once a function finished STACK_AUTO_WARMUP times,
+  // async_call gives it its peak plus a margin instead of STACK_SIZE.
+  bool stack_auto_size;
+  // Awaits and socket calls a task may make in a row before it yields, even
+  // if none of them had to wait. 0 means ASYNC_COOP_BUDGET, negative turns
+  // the budget off.
+  int coop_budget;
+  // Time slice in microseconds of tasks inside async_preemptible_begin/end,
+  // which are switched out by a timer signal once it is used up. 0 turns
+  // preemption off. Not available with SCHEDULER_STEAL.
+  long preempt_us;
+} RuntimeOptions;
+
+typedef struct {
+  AsyncFunction *fn;
+  unsigned long peak;       // deepest stack use seen, in bytes
+  long tasks;               // finished tasks that were measured
+  unsigned long stack_size; // size async_call picks for fn, 0 if STACK_SIZE
+} AsyncStackStats;
+
+typedef struct {
+  unsigned long stack_size; // 0 means STACK_SIZE, rounded up to a size class
+  int priority;             // below ASYNC_PRIORITIES, see async_set_priority
+  int group; // from async_group_create, 0 means the group of the caller
+} CallOptions;
 
 void run_async_main(AsyncFunction *main_fn, void *arg);
+void run_async_main_ex(AsyncFunction *main_fn, void *arg,
+                       const RuntimeOptions *opts);
 Handle async_call(AsyncFunction *f, void *arg);
+Handle async_call_ex(AsyncFunction *f, void *arg, const CallOptions *opts);
 void *await(Handle other_fn);
+// Same as await(async_call(f, arg)), but f runs right away on the caller's
+// stack: no stack, task or context switch of its own. If f has to wait for
+// something, the caller waits with it. f must fit on the caller's stack.
+void *await_call(AsyncFunction *f, void *arg);
 void async_return(void *data);
 void async_free(Handle h);
 void async_orphan(Handle h);
 void *await_any(Handle *handles, int len, int *res_idx);
 void await_all(Handle *handles, int len, void **results);
 void async_skip();
+// Runs fn(arg) on a pool thread, for calls that would block the runtime's
+// thread such as getaddrinfo, regular file reads or fsync. The handle
+// finishes with what fn returned. fn runs outside of the runtime and must not
+// call anything from this header, and with shared stacks arg must not point
+// into the caller's stack.
+Handle async_spawn_blocking(BlockingFunction *fn, void *arg);
+// Parks the calling task for at least ns nanoseconds, rounded up to whole
+// TIMER_TICK_NS, while other tasks run.
+void async_sleep_ns(long ns);
+// await that gives up after timeout_ns: returns false if h has not finished
+// by then and leaves it running, otherwise stores its result in *result
+// unless result is NULL.
+bool await_timeout(Handle h, long timeout_ns, void **result);
+// Parks the calling task until some task transfers back to it or h returns,
+// and runs h. If h is parked in async_transfer itself, it resumes right away
+// in the caller's place; otherwise it runs whenever its turn comes.
+void async_transfer(Handle h);
+// Only SCHEDULER_PRIORITY looks at priorities. A task awaiting one of lower
+// priority lends it its own for as long as it waits, and so on down to
+// whatever that task is awaiting in turn.
+void async_set_priority(Handle h, int priority);
+// Task groups of SCHEDULER_FAIR, other schedulers ignore them. Groups with
+// ready tasks get CPU time in proportion to their weight, counted in cycles
+// spent between switches, minus time the thread was descheduled. Tasks stay
+// in the group they were spawned into.
+int async_group_create(unsigned weight);
+// Keeps the group below percent of the CPU while other groups have work,
+// 0 lifts the cap. Spare time nobody else wants still goes to it.
+void async_group_set_cap(int group, int percent);
+// Marks code the running task may be switched out of at any instruction,
+// such as a long computation. It must not hold locks or call into anything
+// other tasks might be in the middle of, malloc and stdio included, and
+// leaves room for a signal frame on its stack. Regions do not nest.
+void async_preemptible_begin();
+// Yields if a time slice ran out while the task could not be preempted.
+void async_preemptible_end();
+int async_shard_id(); // 0 unless RuntimeOptions.shards is used
+// Fills out with up to cap functions and returns how many there are in total.
+int async_stack_stats(AsyncStackStats *out, int cap);
 
 #endif
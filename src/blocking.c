@@ -0,0 +1,160 @@
+#include "blocking.h"
+#include "reactor.h"
+#include "scheduler.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// One pool for the whole process, every runtime and shard hands it jobs.
+// Threads are started as jobs come in while none is idle, up to
+// ASYNC_BLOCKING_THREADS, and then stay around waiting for more.
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  BlockingJob *head, *tail;
+  int threads;
+  int idle;
+} pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+static void report(BlockingJob *job) {
+  Blocking *b = job->owner;
+  pthread_mutex_lock(&b->lock);
+  job->next = b->done;
+  b->done = job;
+  pthread_mutex_unlock(&b->lock);
+  uint64_t one = 1;
+  if (write(b->efd, &one, sizeof(one)) != sizeof(one)) {
+    perror("eventfd write");
+    exit(1);
+  }
+}
+
+static void *pool_thread(void *args) {
+  pthread_mutex_lock(&pool.lock);
+  while (true) {
+    while (!pool.head) {
+      pool.idle++;
+      pthread_cond_wait(&pool.ready, &pool.lock);
+      pool.idle--;
+    }
+    BlockingJob *job = pool.head;
+    pool.head = job->next;
+    if (!pool.head)
+      pool.tail = NULL;
+    pthread_mutex_unlock(&pool.lock);
+    job->result = job->fn(job->arg);
+    report(job);
+    pthread_mutex_lock(&pool.lock);
+  }
+  return NULL;
+}
+
+static void pool_submit(BlockingJob *job) {
+  job->next = NULL;
+  pthread_mutex_lock(&pool.lock);
+  if (pool.tail) {
+    pool.tail->next = job;
+  } else {
+    pool.head = job;
+  }
+  pool.tail = job;
+  if (pool.idle == 0 && pool.threads < ASYNC_BLOCKING_THREADS) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, pool_thread, NULL) != 0) {
+      perror("pthread_create");
+      exit(1);
+    }
+    pthread_detach(thread);
+    pool.threads++;
+  }
+  pthread_cond_signal(&pool.ready);
+  pthread_mutex_unlock(&pool.lock);
+}
+
+static Blocking *runtime_blocking() {
+  Runtime *rt = current_runtime();
+  if (!rt->blocking) {
+    Blocking *b = calloc(1, sizeof(Blocking));
+    assert(b);
+    b->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (b->efd == -1) {
+      perror("eventfd");
+      exit(1);
+    }
+    pthread_mutex_init(&b->lock, NULL);
+    rt->blocking = b;
+  }
+  return rt->blocking;
+}
+
+// Waits on the eventfd while jobs are out and wakes their tasks as they come
+// back, then finishes so that an idle runtime has nothing parked on it.
+static void collector(void *args) {
+  Blocking *b = args;
+  while (true) {
+    runtime_lock();
+    if (b->outstanding == 0) {
+      b->collecting = false;
+      runtime_unlock();
+      break;
+    }
+    runtime_unlock();
+    await_fd(b->efd, EPOLLIN);
+    uint64_t count;
+    if (read(b->efd, &count, sizeof(count)) != sizeof(count))
+      continue;
+    pthread_mutex_lock(&b->lock);
+    BlockingJob *done = b->done;
+    b->done = NULL;
+    pthread_mutex_unlock(&b->lock);
+    runtime_lock();
+    for (BlockingJob *job = done; job; job = job->next) {
+      b->outstanding--;
+      wake_task(job->task);
+    }
+    runtime_unlock();
+  }
+  async_return(NULL);
+}
+
+static void blocking_task(void *args) {
+  BlockingJob *job = args;
+  runtime_lock();
+  Blocking *b = runtime_blocking();
+  job->task = current_task_handle();
+  job->owner = b;
+  b->outstanding++;
+  if (!b->collecting) {
+    b->collecting = true;
+    Handle h = start_new_task(collector, b, &(CallOptions){.stack_size = 8192});
+    get_task(h)->orphaned = true;
+  }
+  pool_submit(job);
+  park_current_task();
+  runtime_unlock();
+  void *result = job->result;
+  free(job);
+  async_return(result);
+}
+
+Handle async_spawn_blocking(BlockingFunction *fn, void *arg) {
+  BlockingJob *job = malloc(sizeof(BlockingJob));
+  assert(job);
+  *job = (BlockingJob){.fn = fn, .arg = arg};
+  return async_call_ex(blocking_task, job, &(CallOptions){.stack_size = 8192});
+}
+
+void blocking_deinit() {
+  Runtime *rt = current_runtime();
+  Blocking *b = rt->blocking;
+  rt->blocking = NULL;
+  if (!b || b->outstanding)
+    return;
+  close(b->efd);
+  pthread_mutex_destroy(&b->lock);
+  free(b);
+}
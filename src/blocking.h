@@ -0,0 +1,33 @@
+#ifndef __BLOCKING_H__
+#define __BLOCKING_H__
+
+#include "async.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+// A call handed to the blocking pool by async_spawn_blocking. Its task stays
+// parked until a pool thread ran it.
+typedef struct BlockingJob {
+  struct BlockingJob *next;
+  BlockingFunction *fn;
+  void *arg;
+  void *result;
+  Handle task;
+  struct Blocking *owner;
+} BlockingJob;
+
+// Per runtime: pool threads put finished jobs on done and bump the eventfd,
+// a task of the runtime waits on it and wakes the jobs' tasks.
+typedef struct Blocking {
+  int efd;
+  pthread_mutex_t lock; // guards done, the pool threads push to it
+  BlockingJob *done;
+  int outstanding; // jobs handed to the pool and not collected yet
+  bool collecting; // the collector task is running
+} Blocking;
+
+// Frees the runtime's state, unless jobs are still running on the pool and
+// are going to report back to it.
+void blocking_deinit();
+
+#endif // !__BLOCKING_H__
@@ -0,0 +1,332 @@
+#define _GNU_SOURCE
+#include "dbg.h"
+#include "reactor.h"
+#include "scheduler.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+typedef struct {
+  Handle reader;
+  Handle writer;
+  bool registered;
+} FdWaiters;
+
+typedef struct {
+  int epoll_fd;
+  FdWaiters *fds;
+  int fds_cap;
+  int waiters; // amount of tasks parked on some fd
+} Epoll;
+
+static FdWaiters *fd_waiters(Epoll *e, int fd) {
+  assert(fd >= 0);
+  if (fd >= e->fds_cap) {
+    int new_cap = e->fds_cap * 2 + 10;
+    if (new_cap <= fd)
+      new_cap = fd + 1;
+    e->fds = realloc(e->fds, new_cap * sizeof(FdWaiters));
+    assert(e->fds);
+    memset(e->fds + e->fds_cap, 0, (new_cap - e->fds_cap) * sizeof(FdWaiters));
+    e->fds_cap = new_cap;
+  }
+  return &e->fds[fd];
+}
+
+// Registrations are one-shot, so after every event the fd has to be armed
+// again for whichever directions still have a parked task. The fd may have
+// been closed and reused since we last saw it, in which case epoll has
+// already forgotten it and MOD fails with ENOENT.
+static void rearm(Epoll *e, int fd, FdWaiters *w) {
+  struct epoll_event ev = {0};
+  ev.data.fd = fd;
+  ev.events = EPOLLONESHOT;
+  if (w->reader.idx)
+    ev.events |= EPOLLIN | EPOLLRDHUP;
+  if (w->writer.idx)
+    ev.events |= EPOLLOUT;
+
+  int op = w->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  if (epoll_ctl(e->epoll_fd, op, fd, &ev) == -1) {
+    if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+      op = EPOLL_CTL_ADD;
+    } else if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+      op = EPOLL_CTL_MOD;
+    } else {
+      perror("epoll_ctl");
+      exit(1);
+    }
+    if (epoll_ctl(e->epoll_fd, op, fd, &ev) == -1) {
+      perror("epoll_ctl");
+      exit(1);
+    }
+  }
+  w->registered = true;
+}
+
+// The timer of a task waiting for fd ran out, arg is fd << 1 | 1 for writers.
+static void fd_timed_out(Handle task, long arg) {
+  Epoll *e = global_reactor()->data;
+  FdWaiters *w = &e->fds[arg >> 1];
+  if (arg & 1) {
+    w->writer = (Handle){0};
+  } else {
+    w->reader = (Handle){0};
+  }
+  e->waiters--;
+  wake_task(task);
+}
+
+bool epoll_wait_fd(void *data, int fd, uint32_t events, uint64_t deadline) {
+  Epoll *e = data;
+  FdWaiters *w = fd_waiters(e, fd);
+  Handle current = current_task_handle();
+  DBG("%d waits for fd %d (%x)", current.idx, fd, events);
+
+  if (events & EPOLLIN) {
+    assert(w->reader.idx == 0 && "fd already has a reader");
+    w->reader = current;
+  } else {
+    assert(events & EPOLLOUT);
+    assert(w->writer.idx == 0 && "fd already has a writer");
+    w->writer = current;
+  }
+  rearm(e, fd, w);
+  e->waiters++;
+
+  if (deadline)
+    timer_start(deadline, fd_timed_out, (long)fd << 1 | !(events & EPOLLIN));
+  park_current_task();
+  return !deadline || !timer_stop();
+}
+
+// The syscalls below run without the runtime lock and may resume on another
+// thread after waiting, so errno is read and set out of line: the compiler
+// would otherwise reuse the thread local address it computed before the
+// switch.
+static __attribute__((noipa)) bool would_block(int status) {
+  return status == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+static __attribute__((noipa)) int timed_out() {
+  errno = ETIMEDOUT;
+  return -1;
+}
+
+int epoll_recv(void *data, int fd, char *buf, int n, int flags,
+               uint64_t deadline) {
+  while (true) {
+    int status = recv(fd, buf, n, flags);
+    if (would_block(status)) {
+      if (!await_fd_until(fd, EPOLLIN, deadline))
+        return timed_out();
+    } else {
+      return status;
+    }
+  }
+}
+
+int epoll_send(void *data, int fd, char *buf, int n, int flags,
+               uint64_t deadline) {
+  while (true) {
+    int status = send(fd, buf, n, flags);
+    if (would_block(status)) {
+      if (!await_fd_until(fd, EPOLLOUT, deadline))
+        return timed_out();
+    } else {
+      return status;
+    }
+  }
+}
+
+int epoll_accept(void *data, int fd, struct sockaddr *addr,
+                 socklen_t *addr_len, uint64_t deadline) {
+  while (true) {
+    int status = accept(fd, addr, addr_len);
+    if (would_block(status)) {
+      if (!await_fd_until(fd, EPOLLIN, deadline))
+        return timed_out();
+    } else {
+      return status;
+    }
+  }
+}
+
+// Files go to the blocking pool. The call is on the heap, and so is buf if
+// it is on a shared stack: a pool thread uses them while the task is away.
+typedef struct {
+  enum { FILE_READ, FILE_WRITE, FILE_SYNC } op;
+  int fd;
+  void *buf;
+  size_t n;
+  off_t off;
+} FileCall;
+
+static void *file_call(void *args) {
+  FileCall *c = args;
+  ssize_t status = 0;
+  switch (c->op) {
+  case FILE_READ:
+    status = pread(c->fd, c->buf, c->n, c->off);
+    break;
+  case FILE_WRITE:
+    status = pwrite(c->fd, c->buf, c->n, c->off);
+    break;
+  case FILE_SYNC:
+    status = fsync(c->fd);
+    break;
+  }
+  return (void *)(status == -1 ? -(long)errno : status);
+}
+
+static __attribute__((noipa)) ssize_t failed(long status) {
+  if (status >= 0)
+    return status;
+  errno = -status;
+  return -1;
+}
+
+static ssize_t offload(FileCall call) {
+  FileCall *c = malloc(sizeof(FileCall));
+  assert(c);
+  *c = call;
+  bool bounce = c->buf && shared_stack_contains(&global_pool()->shared, c->buf);
+  if (bounce) {
+    c->buf = malloc(c->n);
+    assert(c->buf);
+    if (c->op == FILE_WRITE)
+      memcpy(c->buf, call.buf, c->n);
+  }
+  Handle h = async_spawn_blocking(file_call, c);
+  long status = (long)await(h);
+  async_free(h);
+  if (bounce) {
+    if (c->op == FILE_READ && status > 0)
+      memcpy(call.buf, c->buf, status);
+    free(c->buf);
+  }
+  free(c);
+  return failed(status);
+}
+
+ssize_t epoll_pread(void *data, int fd, void *buf, size_t n, off_t off) {
+  // whatever the page cache already holds is read right here
+  struct iovec iov = {buf, n};
+  ssize_t status = preadv2(fd, &iov, 1, off, RWF_NOWAIT);
+  if (status != -1 || (errno != EAGAIN && errno != EOPNOTSUPP))
+    return status;
+  return offload((FileCall){FILE_READ, fd, buf, n, off});
+}
+
+ssize_t epoll_pwrite(void *data, int fd, const void *buf, size_t n,
+                     off_t off) {
+  return offload((FileCall){FILE_WRITE, fd, (void *)buf, n, off});
+}
+
+int epoll_fsync(void *data, int fd) {
+  return offload((FileCall){FILE_SYNC, fd});
+}
+
+int epoll_close(void *data, int fd) {
+  Epoll *e = data;
+  runtime_lock();
+  if (fd >= 0 && fd < e->fds_cap) {
+    FdWaiters *w = &e->fds[fd];
+    assert(!w->reader.idx && !w->writer.idx && "closing fd with waiters");
+    w->registered = false;
+  }
+  int status = close(fd);
+  runtime_unlock();
+  return status;
+}
+
+int epoll_poll(void *data, int timeout_ms) {
+  Epoll *e = data;
+  // with only timers running the wait is a sleep until the first one
+  if (e->waiters == 0 && timeout_ms == 0)
+    return 0;
+
+  // other workers keep running tasks while this one blocks
+  struct epoll_event events[REACTOR_EVENTS];
+  if (timeout_ms != 0)
+    runtime_release();
+  int n = epoll_wait(e->epoll_fd, events, REACTOR_EVENTS, timeout_ms);
+  if (timeout_ms != 0)
+    runtime_reacquire();
+  if (n == -1) {
+    if (errno == EINTR)
+      return 0;
+    perror("epoll_wait");
+    exit(1);
+  }
+
+  int woken = 0;
+  for (int i = 0; i < n; i++) {
+    int fd = events[i].data.fd;
+    uint32_t ev = events[i].events;
+    FdWaiters *w = &e->fds[fd];
+
+    if ((ev & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) && w->reader.idx) {
+      wake_task(w->reader);
+      w->reader = (Handle){0};
+      e->waiters--;
+      woken++;
+    }
+    if ((ev & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && w->writer.idx) {
+      wake_task(w->writer);
+      w->writer = (Handle){0};
+      e->waiters--;
+      woken++;
+    }
+    if (w->reader.idx || w->writer.idx)
+      rearm(e, fd, w);
+  }
+  return woken;
+}
+
+int epoll_pending(void *data) {
+  Epoll *e = data;
+  return e->waiters;
+}
+
+void epoll_cleanup(void *data) {
+  Epoll *e = data;
+  if (e->epoll_fd != -1)
+    close(e->epoll_fd);
+  free(e->fds);
+  free(e);
+}
+
+static ReactorVTable vtable = {
+    .wait_fd = epoll_wait_fd,
+    .recv = epoll_recv,
+    .send = epoll_send,
+    .accept = epoll_accept,
+    .pread = epoll_pread,
+    .pwrite = epoll_pwrite,
+    .fsync = epoll_fsync,
+    .close = epoll_close,
+    .poll = epoll_poll,
+    .pending = epoll_pending,
+    .cleanup = epoll_cleanup,
+};
+
+void use_epoll_reactor() {
+  Epoll *e = calloc(1, sizeof(Epoll));
+  assert(e);
+  e->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (e->epoll_fd == -1) {
+    perror("epoll_create1");
+    exit(1);
+  }
+  Reactor *r = global_reactor();
+  r->data = e;
+  r->vtable = &vtable;
+}
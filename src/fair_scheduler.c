@@ -0,0 +1,229 @@
+#include "scheduler.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h>
+
+// Every group has a run queue and a virtual clock that advances by the
+// cycles its tasks ran, scaled down by its weight. The next task comes from
+// the group with the earliest clock, so over time groups get the CPU in
+// proportion to their weights. A group over its cap in the current period
+// only runs when no other group has anything ready.
+//
+// Cycles are wall time, so whenever the OS runs another thread that time
+// would go to whichever group was running. A slice long enough to hide that
+// is checked against the thread's CPU time and the difference taken off.
+
+#ifndef FAIR_PERIOD_CYCLES
+#define FAIR_PERIOD_CYCLES (1ull << 24) // a few ms
+#endif
+
+// slices longer than this are checked for time the thread was descheduled
+#ifndef FAIR_STEAL_CHECK_CYCLES
+#define FAIR_STEAL_CHECK_CYCLES (1ull << 17) // some 50us
+#endif
+
+typedef struct {
+  uint64_t tsc;
+  long wall_ns, cpu_ns;
+} Clocks;
+
+typedef struct {
+  RunQueue queue;
+  uint64_t vruntime; // cycles run * ASYNC_GROUP_DEFAULT_WEIGHT / weight
+  uint64_t used;     // cycles run in the current period
+} FairGroup;
+
+typedef struct {
+  FairGroup *groups; // indexed like TaskPool.groups, grown on first use
+  int len;
+  int current;           // idx of the running task, 0 while idle
+  uint64_t started;      // tsc when current was picked
+  uint64_t min_vruntime; // clock of the last group picked, never goes back
+  uint64_t period;       // cycles charged in the current period
+  Clocks synced;         // when stolen time was last checked
+} Fair;
+
+static FairGroup *group_of(Fair *f, int idx) {
+  int g = task_at(idx)->group;
+  if (g >= f->len) {
+    f->groups = realloc(f->groups, (g + 1) * sizeof(FairGroup));
+    assert(f->groups);
+    memset(f->groups + f->len, 0, (g + 1 - f->len) * sizeof(FairGroup));
+    for (int i = f->len; i <= g; i++)
+      run_queue_init(&f->groups[i].queue);
+    f->len = g + 1;
+  }
+  return &f->groups[g];
+}
+
+static void enqueue(Fair *f, int idx, bool front) {
+  FairGroup *g = group_of(f, idx);
+  // a group coming back from idle does not get to catch up on lost time
+  if (!g->queue.head && g->vruntime < f->min_vruntime)
+    g->vruntime = f->min_vruntime;
+  if (front)
+    run_queue_push_front(&g->queue, idx);
+  else
+    run_queue_push_back(&g->queue, idx);
+}
+
+static long ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void sync_clocks(Fair *f) {
+  f->synced = (Clocks){__rdtsc(), ns(CLOCK_MONOTONIC),
+                       ns(CLOCK_THREAD_CPUTIME_ID)};
+}
+
+// Cycles other threads got since the clocks were last synced. The CPU time
+// clock is a syscall, so this only runs for long slices and once a period.
+static uint64_t stolen(Fair *f) {
+  Clocks last = f->synced;
+  sync_clocks(f);
+  long wall = f->synced.wall_ns - last.wall_ns;
+  long cpu = f->synced.cpu_ns - last.cpu_ns;
+  if (wall <= 0 || cpu >= wall)
+    return 0;
+  return (double)(wall - cpu) * (f->synced.tsc - last.tsc) / wall;
+}
+
+// Bills the cycles since current was picked to its group, whatever is picked
+// next starts counting from here.
+static void charge(Fair *f) {
+  if (!f->current)
+    return;
+  uint64_t now = __rdtsc();
+  uint64_t cycles = now - f->started;
+  f->started = now;
+  if (cycles > FAIR_STEAL_CHECK_CYCLES) {
+    uint64_t away = stolen(f);
+    cycles -= away < cycles ? away : cycles;
+  }
+  int gi = task_at(f->current)->group;
+  FairGroup *g = &f->groups[gi];
+  g->vruntime += cycles * ASYNC_GROUP_DEFAULT_WEIGHT / group_at(gi).weight;
+  g->used += cycles;
+  f->period += cycles;
+  if (f->period > FAIR_PERIOD_CYCLES) {
+    for (int i = 0; i < f->len; i++)
+      f->groups[i].used = 0;
+    f->period = 0;
+    sync_clocks(f);
+  }
+}
+
+static bool over_cap(Fair *f, int gi) {
+  int cap = group_at(gi).cap;
+  return cap && f->groups[gi].used * 100 > (uint64_t)cap * f->period;
+}
+
+static int pick(Fair *f) {
+  int best = -1, capped = -1;
+  for (int i = 0; i < f->len; i++) {
+    FairGroup *g = &f->groups[i];
+    if (!g->queue.head)
+      continue;
+    int *slot = over_cap(f, i) ? &capped : &best;
+    if (*slot < 0 || g->vruntime < f->groups[*slot].vruntime)
+      *slot = i;
+  }
+  if (best < 0)
+    best = capped;
+  if (best < 0)
+    return f->current = 0;
+  FairGroup *g = &f->groups[best];
+  if (g->vruntime > f->min_vruntime)
+    f->min_vruntime = g->vruntime;
+  return f->current = g->queue.head;
+}
+
+void fair_register_task(void *data, Handle h) { enqueue(data, h.idx, false); }
+
+void fair_finish_task(void *data, Handle *cur, Handle *next) {
+  Fair *f = data;
+  assert(f->current);
+  charge(f);
+  run_queue_remove(&group_of(f, f->current)->queue, f->current);
+  *cur = task_handle(f->current);
+  // the handoff only wins if its group is due anyway
+  if (next->idx)
+    enqueue(f, next->idx, true);
+  *next = pick(f) ? task_handle(f->current) : (Handle){0};
+}
+
+void fair_free_task(void *data, Handle h) {
+  //
+}
+
+State fair_poll_task(void *data, Handle h) { return get_hot(h)->state; }
+
+void fair_wait_ready(void *data, Handle h) {
+  if (poll_state(h) != READY)
+    wait_tasks(&h, 1, 1);
+}
+
+Handle fair_current_task(void *data) {
+  Fair *f = data;
+  if (!f->current) {
+    // coming back from idle, nothing to charge
+    if (!pick(f))
+      return (Handle){0};
+    f->started = __rdtsc();
+    // idle time is no one's
+    sync_clocks(f);
+  }
+  return task_handle(f->current);
+}
+
+Handle fair_next_task(void *data) {
+  Fair *f = data;
+  assert(f->current);
+  charge(f);
+  run_queue_rotate(&group_of(f, f->current)->queue);
+  pick(f);
+  return task_handle(f->current);
+}
+
+void fair_park_task(void *data, Handle *cur, Handle *next) {
+  fair_finish_task(data, cur, next);
+}
+
+void fair_wake_task(void *data, Handle h) { enqueue(data, h.idx, false); }
+
+void fair_set_priority(void *data, Handle h, int priority) {}
+
+void fair_cleanup(void *data) {
+  Fair *f = data;
+  free(f->groups);
+  free(f);
+}
+
+const SchedulerKind fair_scheduler_kind = SCHEDULER_FAIR;
+
+static SchedulerVTable vtable = {
+    .register_task = fair_register_task,
+    .finish_task = fair_finish_task,
+    .free_task = fair_free_task,
+    .poll_task = fair_poll_task,
+    .wait_ready = fair_wait_ready,
+    .current_task = fair_current_task,
+    .next_task = fair_next_task,
+    .park_task = fair_park_task,
+    .wake_task = fair_wake_task,
+    .set_priority = fair_set_priority,
+    .cleanup = fair_cleanup,
+};
+
+void use_fair_scheduler() {
+  Fair *f = calloc(1, sizeof(Fair));
+  assert(f);
+  Scheduler *s = global_scheduler();
+  s->vtable = &vtable;
+  s->data = f;
+}
@@ -1,7 +1,5 @@
 #include "async.h"
-#include "hashmap.h"
 #include "scheduler.h"
-#include "storage.h"
 #include "switch.h"
 #include <assert.h>
 #include <inttypes.h>
@@ -11,191 +9,130 @@
 #include <stdlib.h>
 #include <string.h>
 
-typedef struct Node {
-  struct Node *parent;
-  Handle h;
-  bool in_queue;
-} Node;
-
+// Parents live in an array indexed by task idx and the run queue is threaded
+// through the tasks, so the hot paths neither hash nor allocate.
 typedef struct {
-  Node **elems;
-  int start, end, cap;
-} NodeQueue;
+  int parent; // idx of the task awaiting this one, 0 if none
+} Node;
 
 typedef struct {
-  NodeQueue queue;
-  HashMap handle_to_node;
+  RunQueue queue;
+  Node *nodes;
+  int cap;
 } Graph;
 
-void verify_queue(NodeQueue *q) {
-#ifdef DEBUG
-  assert(q);
-  assert(q->start >= 0);
-  assert(q->end <= q->cap);
-  assert(q->end >= 0);
-  assert(q->start <= q->end);
-  if (q->cap)
-    assert(q->elems);
-  for (int i = q->start; i < q->end; i++) {
-    assert(q->elems[i]);
-    assert(q->elems[i]->in_queue);
-    assert(q->elems[i]->h.idx);
-    for (int j = i + 1; j < q->end; j++) {
-      assert(q->elems[i] != q->elems[j]);
-    }
-  }
-#endif
+static Node *graph_node(Graph *g, int idx) {
+  assert(idx > 0 && idx < g->cap);
+  return &g->nodes[idx];
 }
 
 void graph_register_task(void *data, Handle h) {
   assert(h.idx);
   Graph *g = data;
-  HashNode *hash_node =
-      hash_map_insert(&g->handle_to_node, (void *)(long)h.idx, sizeof(int));
-  Node *n = NULL;
-  if (hash_node->val == NULL) {
-    n = calloc(1, sizeof(Node));
-    hash_node->val = (void *)n;
+  if (h.idx >= g->cap) {
+    int cap = g->cap ? g->cap : 64;
+    while (cap <= h.idx)
+      cap *= 2;
+    g->nodes = realloc(g->nodes, cap * sizeof(Node));
+    assert(g->nodes);
+    memset(g->nodes + g->cap, 0, (cap - g->cap) * sizeof(Node));
+    g->cap = cap;
   }
-  n->h = h;
-  n->parent = NULL;
-  n->in_queue = true;
-
-  verify_queue(&g->queue);
-  queue_push_back(&g->queue, n);
-  verify_queue(&g->queue);
-
-  hash_node->val = (void *)n;
+  g->nodes[h.idx].parent = 0;
+  run_queue_push_back(&g->queue, h.idx);
 }
 
 void graph_finish_task(void *data, Handle *current, Handle *next) {
   Graph *g = data;
-  Node *cur_node = NULL;
-  verify_queue(&g->queue);
-  queue_pop_front(&g->queue, &cur_node);
-  verify_queue(&g->queue);
-
-  assert(cur_node);
-  assert(cur_node->in_queue);
-  assert(cur_node->h.idx);
-  cur_node->in_queue = false;
-  *current = cur_node->h;
-  Node *parent = cur_node->parent;
-  if (parent && !parent->in_queue) {
-    *next = parent->h;
-    parent->in_queue = true;
-
-    verify_queue(&g->queue);
-    queue_push_front(&g->queue, parent);
-    verify_queue(&g->queue);
-  } else {
-    Node *next_node = NULL;
-    verify_queue(&g->queue);
-    queue_peek_front(&g->queue, &next_node);
-    verify_queue(&g->queue);
-    assert(next_node);
-    assert(next_node->in_queue);
-    assert(next_node->h.idx);
-    *next = next_node->h;
+  int cur = run_queue_pop_front(&g->queue);
+  int parent = g->nodes[cur].parent;
+  if (parent && run_queued(parent))
+    parent = 0;
+  *current = task_handle(cur);
+  if (next->idx) {
+    run_queue_push_front(&g->queue, next->idx);
+    // the parent is woken all the same, just not first
+    if (parent && !run_queued(parent))
+      run_queue_push_back(&g->queue, parent);
+    return;
   }
+  if (parent) {
+    // the awaiting parent takes the place of the child
+    run_queue_push_front(&g->queue, parent);
+    *next = task_handle(parent);
+    return;
+  }
+  *next = g->queue.head ? task_handle(g->queue.head) : (Handle){0};
 }
 
 void graph_free_task(void *data, Handle h) {
   Graph *g = data;
-  HashNode *hash_node =
-      hash_map_remove(&g->handle_to_node, (void *)(long)h.idx, sizeof(int));
-  assert(hash_node);
-  Node *n = (void *)hash_node->val;
-  assert(n);
-  assert(!n->in_queue);
-  assert(n->h.idx);
-  n->h.idx = 0;
-  n->in_queue = false;
+  assert(!run_queued(h.idx));
+  graph_node(g, h.idx)->parent = 0;
 }
 
 State graph_poll_task(void *data, Handle h) {
   assert(h.idx);
-  return global_pool()->tasks[h.idx - 1].state;
+  return get_hot(h)->state;
 }
 
 void graph_wait_ready(void *data, Handle h) {
   Graph *g = data;
-  Node *n = NULL;
-  verify_queue(&g->queue);
-  queue_pop_front(&g->queue, &n);
-  verify_queue(&g->queue);
-  assert(n);
-  assert(n->in_queue);
-  assert(n->h.idx);
-  n->in_queue = false;
-  Handle parent = n->h;
-  HashNode *hash_node =
-      hash_map_find(&g->handle_to_node, (void *)(long)h.idx, sizeof(int));
-  assert(hash_node);
-  Node *child = (void *)hash_node->val;
-
-  assert(!child->parent);
-  assert(child->h.idx == h.idx);
-  assert(child->h.idx);
-  child->parent = n;
-  if (!child->in_queue) {
-    child->in_queue = true;
-    verify_queue(&g->queue);
-    queue_push_front(&g->queue, child);
-    verify_queue(&g->queue);
+  if (graph_poll_task(data, h) == READY)
+    return;
+  Node *child = graph_node(g, h.idx);
+  if (child->parent) {
+    // somebody is already awaiting this child, the rest go to its waiters
+    wait_tasks(&h, 1, 1);
+    return;
   }
-  Node *next = NULL;
-  queue_peek_front(&g->queue, &next);
-  assert(next);
-  assert(next->h.idx);
-  assert(next->in_queue);
-  async_switch(parent, next->h);
+
+  int idx = run_queue_pop_front(&g->queue);
+  Handle parent = task_handle(idx);
+  child->parent = idx;
+  // a child outside of the queue is parked, it gets back in by itself
+  Handle next = wait_runnable_task();
+  async_switch(parent, next);
   assert(current_task_handle().idx == parent.idx);
-  assert(poll_state(child->h) == READY);
+  assert(poll_state(h) == READY);
 }
 
 Handle graph_current_task(void *data) {
   Graph *g = data;
-  Node *n = NULL;
-  verify_queue(&g->queue);
-  queue_peek_front(&g->queue, &n);
-  verify_queue(&g->queue);
-  assert(n);
-  assert(n->in_queue);
-  assert(n->h.idx);
-  return n->h;
+  return g->queue.head ? task_handle(g->queue.head) : (Handle){0};
 }
 
 Handle graph_next_task(void *data) {
   Graph *g = data;
-  Node *cur = NULL;
-  verify_queue(&g->queue);
-  queue_pop_front(&g->queue, &cur);
-  verify_queue(&g->queue);
-  assert(cur);
-  assert(cur->in_queue);
-  assert(cur->h.idx);
-  verify_queue(&g->queue);
-  queue_push_back(&g->queue, cur);
-  verify_queue(&g->queue);
-  Node *next = NULL;
-  verify_queue(&g->queue);
-  queue_peek_front(&g->queue, &next);
-  verify_queue(&g->queue);
-  assert(next);
-  assert(next->in_queue);
-  return next->h;
+  run_queue_rotate(&g->queue);
+  return task_handle(g->queue.head);
 }
 
-void graph_hash_node_deinit(HashNode *n) { free(n->val); }
+void graph_park_task(void *data, Handle *current, Handle *next) {
+  Graph *g = data;
+  *current = task_handle(run_queue_pop_front(&g->queue));
+  if (next->idx) {
+    run_queue_push_front(&g->queue, next->idx);
+    return;
+  }
+  *next = graph_current_task(data);
+}
+
+void graph_wake_task(void *data, Handle h) {
+  Graph *g = data;
+  run_queue_push_back(&g->queue, h.idx);
+}
+
+void graph_set_priority(void *data, Handle h, int priority) {}
+
 void graph_cleanup(void *data) {
   Graph *g = data;
-  hash_map_deinit(&g->handle_to_node, graph_hash_node_deinit);
-  if (g->queue.cap)
-    free(g->queue.elems);
+  free(g->nodes);
+  free(g);
 }
 
-static Graph graph = {0};
+const SchedulerKind graph_scheduler_kind = SCHEDULER_GRAPH;
+
 static SchedulerVTable vtable = {
     .register_task = graph_register_task,
     .finish_task = graph_finish_task,
@@ -204,23 +141,17 @@ static SchedulerVTable vtable = {
     .wait_ready = graph_wait_ready,
     .current_task = graph_current_task,
     .next_task = graph_next_task,
+    .park_task = graph_park_task,
+    .wake_task = graph_wake_task,
+    .set_priority = graph_set_priority,
     .cleanup = graph_cleanup,
 };
 
-int int_eql_fn(void *ctx, const char *x, const char *y, int size) {
-  assert(size == sizeof(int));
-  return (int)(long)x - (int)(long)y;
-}
-
-uint64_t int_hash_fn(void *ctx, const char *x, int size) {
-  assert(size == sizeof(int));
-  return (int)(long)x;
-}
-
 void use_graph_scheduler() {
-  graph.handle_to_node.equality_fn = int_eql_fn;
-  graph.handle_to_node.hash_fn = int_hash_fn;
+  Graph *graph = calloc(1, sizeof(Graph));
+  assert(graph);
+  run_queue_init(&graph->queue);
   Scheduler *s = global_scheduler();
-  s->data = &graph;
+  s->data = graph;
   s->vtable = &vtable;
 }
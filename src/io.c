@@ -1,37 +1,52 @@
+#define _GNU_SOURCE
 #include "io.h"
 #include "async.h"
 #include "dbg.h"
+#include "reactor.h"
+#include "scheduler.h"
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 
+// the *_impl tasks only wrap a single syscall
+#ifndef IO_TASK_STACK_SIZE
+#define IO_TASK_STACK_SIZE 8192
+#endif
+
+static const CallOptions io_task = {.stack_size = IO_TASK_STACK_SIZE};
+
+// The task may only start after the caller returned, so its arguments are
+// packed on the heap and freed by the task once unpacked.
+#define IO_ARGS_SIZE 64
+
+static char *io_args() {
+  char *args = calloc(1, IO_ARGS_SIZE);
+  assert(args);
+  return args;
+}
+
 void async_recv_impl(void *args) {
   int fd = 0, n = 0, flags = 0;
   char *buf = NULL;
   unpack(args, "ipii", &fd, &buf, &n, &flags);
-
-  int status = -1;
-  while (true) {
-    status = recv(fd, buf, n, flags);
-    if (status == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-      async_skip();
-    } else {
-      break;
-    }
-  }
-
+  free(args);
+  int status = await_async_recv(fd, buf, n, flags);
   async_return((void *)(long)status);
 }
 
 Handle async_recv(int fd, char *buf, int n, int flags) {
-  char arg_buf[256] = {0};
-  pack(arg_buf, sizeof(arg_buf), "ipii", fd, buf, n, flags);
-  Handle h = async_call(async_recv_impl, arg_buf);
+  char *arg_buf = io_args();
+  pack(arg_buf, IO_ARGS_SIZE, "ipii", fd, buf, n, flags);
+  Handle h = async_call_ex(async_recv_impl, arg_buf, &io_task);
   return h;
 }
 
@@ -39,24 +54,15 @@ void async_send_impl(void *args) {
   int fd = 0, n = 0, flags = 0;
   char *buf = NULL;
   unpack(args, "ipii", &fd, &buf, &n, &flags);
-
-  int status = -1;
-  while (true) {
-    status = send(fd, buf, n, flags);
-    if (status == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-      async_skip();
-    } else {
-      break;
-    }
-  }
-
+  free(args);
+  int status = await_async_send(fd, buf, n, flags);
   async_return((void *)(long)status);
 }
 
 Handle async_send(int fd, char *buf, int n, int flags) {
-  char arg_buf[256] = {0};
-  pack(arg_buf, sizeof(arg_buf), "ipii", fd, buf, n, flags);
-  Handle h = async_call(async_send_impl, arg_buf);
+  char *arg_buf = io_args();
+  pack(arg_buf, IO_ARGS_SIZE, "ipii", fd, buf, n, flags);
+  Handle h = async_call_ex(async_send_impl, arg_buf, &io_task);
   return h;
 }
 
@@ -65,66 +71,188 @@ void async_accept_impl(void *args) {
   struct sockaddr *addr = NULL;
   socklen_t *addr_len = NULL;
   unpack(args, "ipp", &fd, &addr, &addr_len);
+  free(args);
+  int status = await_async_accept(fd, addr, addr_len);
+  async_return((void *)(long)status);
+}
 
-  int status = -1;
-  while (true) {
-    status = accept(fd, addr, addr_len);
-    if (status == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-      async_skip();
-    } else {
-      break;
-    }
-  }
+Handle async_accept(int fd, struct sockaddr *addr, socklen_t *addr_len) {
+  char *arg_buf = io_args();
+  pack(arg_buf, IO_ARGS_SIZE, "ipp", fd, addr, addr_len);
+  Handle h = async_call_ex(async_accept_impl, arg_buf, &io_task);
+  return h;
+}
 
+void async_pread_impl(void *args) {
+  int fd = 0;
+  void *buf = NULL, *n = NULL, *off = NULL;
+  unpack(args, "ippp", &fd, &buf, &n, &off);
+  free(args);
+  ssize_t status = await_async_pread(fd, buf, (size_t)n, (off_t)off);
+  async_return((void *)status);
+}
+
+Handle async_pread(int fd, void *buf, size_t n, off_t off) {
+  char *arg_buf = io_args();
+  pack(arg_buf, IO_ARGS_SIZE, "ippp", fd, buf, (void *)n, (void *)off);
+  Handle h = async_call_ex(async_pread_impl, arg_buf, &io_task);
+  return h;
+}
+
+void async_pwrite_impl(void *args) {
+  int fd = 0;
+  void *buf = NULL, *n = NULL, *off = NULL;
+  unpack(args, "ippp", &fd, &buf, &n, &off);
+  free(args);
+  ssize_t status = await_async_pwrite(fd, buf, (size_t)n, (off_t)off);
+  async_return((void *)status);
+}
+
+Handle async_pwrite(int fd, const void *buf, size_t n, off_t off) {
+  char *arg_buf = io_args();
+  pack(arg_buf, IO_ARGS_SIZE, "ippp", fd, buf, (void *)n, (void *)off);
+  Handle h = async_call_ex(async_pwrite_impl, arg_buf, &io_task);
+  return h;
+}
+
+void async_fsync_impl(void *args) {
+  int fd = 0;
+  unpack(args, "i", &fd);
+  free(args);
+  int status = await_async_fsync(fd);
   async_return((void *)(long)status);
 }
 
-Handle async_accept(int fd, struct sockaddr *addr, socklen_t *addr_len) {
-  char arg_buf[256] = {0};
-  pack(arg_buf, sizeof(arg_buf), "ipp", fd, addr, addr_len);
-  Handle h = async_call(async_accept_impl, arg_buf);
+Handle async_fsync(int fd) {
+  char *arg_buf = io_args();
+  pack(arg_buf, IO_ARGS_SIZE, "i", fd);
+  Handle h = async_call_ex(async_fsync_impl, arg_buf, &io_task);
   return h;
 }
 
-int await_async_recv(int fd, char *buf, int n, int flags) {
-  int status = -1;
-  while (true) {
-    status = recv(fd, buf, n, flags);
-    if (status == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-      async_skip();
-    } else {
-      break;
-    }
-  }
+void async_sendfile_impl(void *args) {
+  int out_fd = 0, in_fd = 0;
+  off_t *offset = NULL;
+  void *count = NULL;
+  unpack(args, "iipp", &out_fd, &in_fd, &offset, &count);
+  free(args);
+  ssize_t status = await_async_sendfile(out_fd, in_fd, offset, (size_t)count);
+  async_return((void *)status);
+}
+
+Handle async_sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+  char *arg_buf = io_args();
+  pack(arg_buf, IO_ARGS_SIZE, "iipp", out_fd, in_fd, offset, (void *)count);
+  Handle h = async_call_ex(async_sendfile_impl, arg_buf, &io_task);
+  return h;
+}
+
+// I/O that never has to wait would otherwise never give up the thread
+static long charged(long status) {
+  runtime_lock();
+  coop_charge();
+  runtime_unlock();
   return status;
 }
 
+int await_async_recv(int fd, char *buf, int n, int flags) {
+  return await_async_recv_timeout(fd, buf, n, flags, -1);
+}
+
 int await_async_send(int fd, char *buf, int n, int flags) {
-  int status = -1;
-  while (true) {
-    status = send(fd, buf, n, flags);
-    if (status == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-      async_skip();
-    } else {
-      break;
-    }
-  }
-  return status;
+  return await_async_send_timeout(fd, buf, n, flags, -1);
 }
 
 int await_async_accept(int fd, struct sockaddr *addr, socklen_t *addr_len) {
-  int status = -1;
+  return await_async_accept_timeout(fd, addr, addr_len, -1);
+}
+
+int await_async_recv_timeout(int fd, char *buf, int n, int flags,
+                             long timeout_ns) {
+  Reactor *r = global_reactor();
+  uint64_t deadline = timer_deadline(timeout_ns);
+  return charged(r->vtable->recv(r->data, fd, buf, n, flags, deadline));
+}
+
+int await_async_send_timeout(int fd, char *buf, int n, int flags,
+                             long timeout_ns) {
+  Reactor *r = global_reactor();
+  uint64_t deadline = timer_deadline(timeout_ns);
+  return charged(r->vtable->send(r->data, fd, buf, n, flags, deadline));
+}
+
+int await_async_accept_timeout(int fd, struct sockaddr *addr,
+                               socklen_t *addr_len, long timeout_ns) {
+  Reactor *r = global_reactor();
+  uint64_t deadline = timer_deadline(timeout_ns);
+  return charged(r->vtable->accept(r->data, fd, addr, addr_len, deadline));
+}
+
+ssize_t await_async_pread(int fd, void *buf, size_t n, off_t off) {
+  Reactor *r = global_reactor();
+  return charged(r->vtable->pread(r->data, fd, buf, n, off));
+}
+
+ssize_t await_async_pwrite(int fd, const void *buf, size_t n, off_t off) {
+  Reactor *r = global_reactor();
+  return charged(r->vtable->pwrite(r->data, fd, buf, n, off));
+}
+
+int await_async_fsync(int fd) {
+  Reactor *r = global_reactor();
+  return charged(r->vtable->fsync(r->data, fd));
+}
+
+// errno is read out of line, the task may have moved threads while waiting
+static __attribute__((noipa)) bool would_block(long status) {
+  return status == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+ssize_t await_async_sendfile(int out_fd, int in_fd, off_t *offset,
+                             size_t count) {
   while (true) {
-    status = accept(fd, addr, addr_len);
-    if (status == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-      async_skip();
-    } else {
-      break;
-    }
+    ssize_t status = sendfile(out_fd, in_fd, offset, count);
+    if (!would_block(status))
+      return charged(status);
+    await_fd(out_fd, EPOLLOUT);
   }
+}
+
+void file_reader_init(FileReader *r, int fd, off_t pos) {
+  *r = (FileReader){.fd = fd, .pos = pos, .ahead = pos};
+  // also makes the kernel's own readahead window larger
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+// Once less than half the window is left, starts reading the next one. The
+// I/O is only started, nothing waits for it here.
+static void read_ahead(FileReader *r) {
+  if (r->ahead - r->pos >= FILE_READAHEAD / 2)
+    return;
+  off_t start = r->ahead > r->pos ? r->ahead : r->pos;
+  off_t end = r->pos + FILE_READAHEAD;
+  posix_fadvise(r->fd, start, end - start, POSIX_FADV_WILLNEED);
+  r->ahead = end;
+}
+
+ssize_t await_file_read(FileReader *r, void *buf, size_t n) {
+  read_ahead(r);
+  ssize_t status = await_async_pread(r->fd, buf, n, r->pos);
+  if (status > 0)
+    r->pos += status;
   return status;
 }
 
+ssize_t await_file_send(FileReader *r, int out_fd, size_t n) {
+  read_ahead(r);
+  return await_async_sendfile(out_fd, r->fd, &r->pos, n);
+}
+
+int async_close(int fd) {
+  Reactor *r = global_reactor();
+  return r->vtable->close(r->data, fd);
+}
+
 int pack(void *buf, int size, const char *fmt, ...) {
   va_list ap;
   va_start(ap, fmt);
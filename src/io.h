@@ -3,6 +3,12 @@
 
 #include "async.h"
 #include <sys/socket.h>
+#include <sys/types.h>
+
+// how far past its position a FileReader keeps the file read ahead
+#ifndef FILE_READAHEAD
+#define FILE_READAHEAD (512 * 1024)
+#endif
 
 Handle async_recv(int fd, char *buf, int n, int flags);
 Handle async_send(int fd, char *buf, int n, int flags);
@@ -12,6 +18,52 @@ int await_async_recv(int fd, char *buf, int n, int flags);
 int await_async_send(int fd, char *buf, int n, int flags);
 int await_async_accept(int fd, struct sockaddr *addr, socklen_t *addr_len);
 
+// The same with a deadline timeout_ns from now, past it they fail with
+// ETIMEDOUT. A negative timeout waits for as long as it takes.
+int await_async_recv_timeout(int fd, char *buf, int n, int flags,
+                             long timeout_ns);
+int await_async_send_timeout(int fd, char *buf, int n, int flags,
+                             long timeout_ns);
+int await_async_accept_timeout(int fd, struct sockaddr *addr,
+                               socklen_t *addr_len, long timeout_ns);
+
+// Positioned reads and writes of regular files and fsync, which fail like
+// the syscalls. The runtime's thread never blocks on the disk: io_uring does
+// them in the kernel, with epoll whatever the page cache holds is read right
+// away and everything else runs on the async_spawn_blocking pool.
+Handle async_pread(int fd, void *buf, size_t n, off_t off);
+Handle async_pwrite(int fd, const void *buf, size_t n, off_t off);
+Handle async_fsync(int fd);
+
+ssize_t await_async_pread(int fd, void *buf, size_t n, off_t off);
+ssize_t await_async_pwrite(int fd, const void *buf, size_t n, off_t off);
+int await_async_fsync(int fd);
+
+// sendfile(2) to a non-blocking socket, waiting whenever it is full. Pages
+// of in_fd that are not cached yet are read on the calling thread, which a
+// FileReader avoids by keeping them read ahead.
+Handle async_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+ssize_t await_async_sendfile(int out_fd, int in_fd, off_t *offset,
+                             size_t count);
+
+// Reads a file front to back and has the kernel start reading the next
+// FILE_READAHEAD bytes into the page cache as it goes, so that the reads and
+// sends find their pages there.
+typedef struct {
+  int fd;
+  off_t pos;   // next byte to read or send
+  off_t ahead; // readahead was started up to here
+} FileReader;
+
+void file_reader_init(FileReader *r, int fd, off_t pos);
+// like await_async_pread and await_async_sendfile, from the reader's position
+ssize_t await_file_read(FileReader *r, void *buf, size_t n);
+ssize_t await_file_send(FileReader *r, int out_fd, size_t n);
+
+// Sockets used with the functions above should be closed with this, the
+// io_uring backend keeps requests armed on them between calls.
+int async_close(int fd);
+
 int pack(void *buf, int size, const char *fmt, ...);
 int unpack(void *buf, const char *fmt, ...);
 
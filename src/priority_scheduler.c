@@ -0,0 +1,113 @@
+#include "scheduler.h"
+#include <assert.h>
+#include <stdlib.h>
+
+// One run queue per priority. The running task stays at the head of its
+// level until it yields, parks or finishes, and the next one comes from the
+// highest level with anything in it, so lower levels only run while all
+// higher ones are parked.
+typedef struct {
+  RunQueue levels[ASYNC_PRIORITIES];
+  int current; // idx of the running task, 0 until one is picked
+} Priority;
+
+static RunQueue *level_of(Priority *p, int idx) {
+  return &p->levels[task_at(idx)->priority];
+}
+
+static int pick(Priority *p) {
+  for (int i = ASYNC_PRIORITIES - 1; i >= 0; i--) {
+    if (p->levels[i].head)
+      return p->current = p->levels[i].head;
+  }
+  return p->current = 0;
+}
+
+void priority_register_task(void *data, Handle h) {
+  run_queue_push_back(level_of(data, h.idx), h.idx);
+}
+
+void priority_finish_task(void *data, Handle *cur, Handle *next) {
+  Priority *p = data;
+  assert(p->current);
+  run_queue_remove(level_of(p, p->current), p->current);
+  *cur = task_handle(p->current);
+  // the handoff only wins if nothing of a higher priority is waiting
+  if (next->idx)
+    run_queue_push_front(level_of(p, next->idx), next->idx);
+  *next = pick(p) ? task_handle(p->current) : (Handle){0};
+}
+
+void priority_free_task(void *data, Handle h) {
+  //
+}
+
+State priority_poll_task(void *data, Handle h) { return get_hot(h)->state; }
+
+void priority_wait_ready(void *data, Handle h) {
+  if (poll_state(h) != READY)
+    wait_tasks(&h, 1, 1);
+}
+
+Handle priority_current_task(void *data) {
+  Priority *p = data;
+  if (!p->current && !pick(p))
+    return (Handle){0};
+  return task_handle(p->current);
+}
+
+Handle priority_next_task(void *data) {
+  Priority *p = data;
+  assert(p->current);
+  run_queue_rotate(level_of(p, p->current));
+  pick(p);
+  return task_handle(p->current);
+}
+
+void priority_park_task(void *data, Handle *cur, Handle *next) {
+  priority_finish_task(data, cur, next);
+}
+
+void priority_wake_task(void *data, Handle h) {
+  run_queue_push_back(level_of(data, h.idx), h.idx);
+}
+
+// Moves h between levels, Task.priority still holds the old one.
+void priority_set_priority(void *data, Handle h, int priority) {
+  Priority *p = data;
+  if (!run_queued(h.idx))
+    return;
+  run_queue_remove(level_of(p, h.idx), h.idx);
+  if (h.idx == p->current)
+    run_queue_push_front(&p->levels[priority], h.idx);
+  else
+    run_queue_push_back(&p->levels[priority], h.idx);
+}
+
+void priority_cleanup(void *data) { free(data); }
+
+const SchedulerKind priority_scheduler_kind = SCHEDULER_PRIORITY;
+
+static SchedulerVTable vtable = {
+    .register_task = priority_register_task,
+    .finish_task = priority_finish_task,
+    .free_task = priority_free_task,
+    .poll_task = priority_poll_task,
+    .wait_ready = priority_wait_ready,
+    .current_task = priority_current_task,
+    .next_task = priority_next_task,
+    .park_task = priority_park_task,
+    .wake_task = priority_wake_task,
+    .set_priority = priority_set_priority,
+    .cleanup = priority_cleanup,
+};
+
+void use_priority_scheduler() {
+  Priority *p = calloc(1, sizeof(Priority));
+  assert(p);
+  for (int i = 0; i < ASYNC_PRIORITIES; i++)
+    run_queue_init(&p->levels[i]);
+  Scheduler *s = global_scheduler();
+  s->vtable = &vtable;
+  s->data = p;
+}
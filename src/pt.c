@@ -0,0 +1,44 @@
+#include "pt.h"
+#include "reactor.h"
+#include "scheduler.h"
+#include "switch.h"
+#include <assert.h>
+
+Handle async_call_pt(PtFunction *fn, Pt *pt) {
+  runtime_lock();
+  pt->resume = 0;
+  Handle h = create_stackless_task((AsyncFunction *)fn, pt);
+  Scheduler *s = global_scheduler();
+  SCHED_CALL(s, register_task, s->data, h);
+  runtime_unlock();
+  return h;
+}
+
+// Runs the task until it has to wait. Waiting switches to another task and
+// never comes back here: the task is started on a fresh host stack again
+// once it can go on.
+void stackless_entry(void *idx) {
+  Handle h = task_handle((int)(long)idx);
+  Task *t = get_task(h);
+  PtFunction *fn = (PtFunction *)t->fn;
+  Pt *pt = t->data;
+  runtime_unlock();
+  while (true) {
+    switch (fn(pt)) {
+    case PT_DONE:
+      async_return(pt->result);
+      break;
+    case PT_YIELDED:
+      async_skip();
+      break;
+    case PT_WAITING:
+      runtime_lock();
+      wait_ready(pt->awaited);
+      runtime_unlock();
+      break;
+    case PT_WAITING_FD:
+      await_fd(pt->fd, pt->events);
+      break;
+    }
+  }
+}
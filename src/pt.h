@@ -0,0 +1,93 @@
+#ifndef __PT_H__
+#define __PT_H__
+
+#include "async.h"
+#include <stdint.h>
+
+// Stackless tasks in the style of protothreads. A PtFunction is called again
+// from the top every time the task resumes and jumps to where it left off,
+// so locals do not survive PT_YIELD, PT_AWAIT or PT_WAIT_FD: anything that
+// has to goes into the struct the Pt is embedded in.
+//
+//   typedef struct {
+//     Pt pt;
+//     Handle child;
+//   } Parent;
+//
+//   PtStatus parent(Pt *pt) {
+//     Parent *p = (Parent *)pt;
+//     void *res;
+//     PT_BEGIN(pt);
+//     p->child = async_call(child, NULL);
+//     PT_AWAIT(pt, p->child, res);
+//     PT_RETURN(pt, res);
+//     PT_END(pt);
+//   }
+//
+// They are handles like any other task, so they can be awaited, orphaned
+// and freed, and can await stackful tasks themselves.
+
+typedef enum {
+  PT_DONE,    // finished with result
+  PT_YIELDED, // runs again after the other runnable tasks
+  PT_WAITING, // resumes once awaited is done
+  PT_WAITING_FD, // resumes once fd is ready for events
+} PtStatus;
+
+typedef struct {
+  int resume; // line to continue at, 0 before the first run
+  union {
+    Handle awaited;
+    struct {
+      int fd;
+      uint32_t events;
+    };
+    void *result;
+  };
+} Pt;
+
+typedef PtStatus PtFunction(Pt *pt);
+
+// Starts fn as a stackless task, pt stays in use until it returns.
+Handle async_call_pt(PtFunction *fn, Pt *pt);
+
+#define PT_BEGIN(pt)                                                           \
+  switch ((pt)->resume) {                                                      \
+  case 0:
+
+#define PT_END(pt)                                                             \
+  }                                                                            \
+  (pt)->result = NULL;                                                         \
+  return PT_DONE
+
+#define __PT_SUSPEND(pt, status)                                               \
+  do {                                                                         \
+    (pt)->resume = __LINE__;                                                   \
+    return (status);                                                           \
+  case __LINE__:;                                                              \
+  } while (0)
+
+#define PT_YIELD(pt) __PT_SUSPEND(pt, PT_YIELDED)
+
+// Waits for the task h and stores what it returned in result.
+#define PT_AWAIT(pt, h, result)                                                \
+  do {                                                                         \
+    (pt)->awaited = (h);                                                       \
+    __PT_SUSPEND(pt, PT_WAITING);                                              \
+    (result) = await((pt)->awaited);                                           \
+  } while (0)
+
+#define PT_WAIT_FD(pt, _fd, _events)                                           \
+  do {                                                                         \
+    (pt)->fd = (_fd);                                                          \
+    (pt)->events = (_events);                                                  \
+    __PT_SUSPEND(pt, PT_WAITING_FD);                                           \
+  } while (0)
+
+#define PT_RETURN(pt, value)                                                   \
+  do {                                                                         \
+    (pt)->result = (void *)(intptr_t)(value);                                  \
+    return PT_DONE;                                                            \
+  } while (0)
+
+#endif // !__PT_H__
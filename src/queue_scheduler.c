@@ -1,77 +1,81 @@
 #include "scheduler.h"
-#include "storage.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <sys/mman.h>
 
-typedef struct {
-  Handle *elems;
-  int start, end, cap;
-} Queue;
-
-void register_task(void *data, Handle h) {
-  Queue *q = data;
-  queue_push_back(q, h);
+void queue_register_task(void *data, Handle h) {
+  RunQueue *q = data;
+  run_queue_push_back(q, h.idx);
 }
 
-void finish_task(void *data, Handle *cur, Handle *next) {
-  Queue *q = data;
-  queue_pop_front(q, cur);
-  queue_peek_front(q, next);
+void queue_finish_task(void *data, Handle *cur, Handle *next) {
+  RunQueue *q = data;
+  *cur = task_handle(run_queue_pop_front(q));
+  if (next->idx) {
+    run_queue_push_front(q, next->idx);
+    return;
+  }
+  if (q->head)
+    *next = task_handle(q->head);
 }
 
 void queue_free_task(void *data, Handle h) {
   //
 }
 
-State poll_task(void *data, Handle pollee) {
-  TaskPool *p = global_pool();
-  return p->tasks[pollee.idx - 1].state;
+State queue_poll_task(void *data, Handle pollee) {
+  return get_hot(pollee)->state;
 }
 
-void busy_wait_ready(void *data, Handle h) {
-  while (poll_state(h) != READY) {
-    async_skip();
-  }
+void queue_wait_ready(void *data, Handle h) {
+  if (poll_state(h) != READY)
+    wait_tasks(&h, 1, 1);
+}
+
+Handle queue_current_task(void *data) {
+  RunQueue *q = data;
+  return q->head ? task_handle(q->head) : (Handle){0};
 }
 
-Handle current_task(void *data) {
-  Queue *q = data;
-  Handle h = {0};
-  queue_peek_front(q, &h);
-  return h;
+Handle queue_next_task(void *data) {
+  RunQueue *q = data;
+  run_queue_rotate(q);
+  return task_handle(q->head);
 }
 
-Handle next_task(void *data) {
-  Queue *q = data;
-  Handle h = {0};
-  queue_pop_front(q, &h);
-  queue_push_back(q, h);
-  queue_peek_front(q, &h);
-  return h;
+void queue_park_task(void *data, Handle *cur, Handle *next) {
+  queue_finish_task(data, cur, next);
 }
 
-void cleanup(void *data) {
-  Queue *q = data;
-  if (q->cap)
-    free(q->elems);
-  *q = (Queue){0};
+void queue_wake_task(void *data, Handle h) {
+  RunQueue *q = data;
+  run_queue_push_back(q, h.idx);
 }
 
+void queue_set_priority(void *data, Handle h, int priority) {}
+
+void queue_cleanup(void *data) { free(data); }
+
+const SchedulerKind queue_scheduler_kind = SCHEDULER_QUEUE;
+
 static SchedulerVTable vtable = {
-    .register_task = register_task,
+    .register_task = queue_register_task,
     .free_task = queue_free_task,
-    .finish_task = finish_task,
-    .poll_task = poll_task,
-    .wait_ready = busy_wait_ready,
-    .current_task = current_task,
-    .next_task = next_task,
-    .cleanup = cleanup,
+    .finish_task = queue_finish_task,
+    .poll_task = queue_poll_task,
+    .wait_ready = queue_wait_ready,
+    .current_task = queue_current_task,
+    .next_task = queue_next_task,
+    .park_task = queue_park_task,
+    .wake_task = queue_wake_task,
+    .set_priority = queue_set_priority,
+    .cleanup = queue_cleanup,
 };
-static Queue queue = {0};
-
 void use_queue_scheduler() {
+  RunQueue *queue = calloc(1, sizeof(RunQueue));
+  assert(queue);
+  run_queue_init(queue);
   Scheduler *s = global_scheduler();
   s->vtable = &vtable;
-  s->data = &queue;
+  s->data = queue;
 }
@@ -0,0 +1,60 @@
+#include "reactor.h"
+#include "scheduler.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+Reactor *global_reactor() { return &current_runtime()->reactor; }
+
+void await_fd(int fd, uint32_t events) { await_fd_until(fd, events, 0); }
+
+bool await_fd_until(int fd, uint32_t events, uint64_t deadline) {
+  runtime_lock();
+  Reactor *r = global_reactor();
+  bool ready = r->vtable->wait_fd(r->data, fd, events, deadline);
+  runtime_unlock();
+  return ready;
+}
+
+// Timers are expired along with every poll, and a blocking poll returns in
+// time for the earliest of them.
+int reactor_poll(int timeout_ms) {
+  Reactor *r = global_reactor();
+  int timers = timers_timeout_ms();
+  if (timers >= 0 && (timeout_ms < 0 || timers < timeout_ms))
+    timeout_ms = timers;
+  int woken = r->vtable->poll(r->data, timeout_ms);
+  return woken + timers_expire();
+}
+
+int reactor_pending() {
+  Reactor *r = global_reactor();
+  return r->vtable->pending(r->data) + timers_pending();
+}
+
+// Blocks until at least one parked task is woken up. Returns false if
+// nothing is parked, i.e. waiting would never end.
+bool reactor_wait() {
+  while (reactor_pending()) {
+    if (reactor_poll(-1))
+      return true;
+  }
+  return false;
+}
+
+void reactor_tick() {
+  Reactor *r = global_reactor();
+  if (++r->ticks < REACTOR_TICK_INTERVAL)
+    return;
+  r->ticks = 0;
+  if (r->vtable->pending(r->data))
+    r->vtable->poll(r->data, 0);
+  timers_expire();
+}
+
+void reactor_deinit() {
+  Reactor *r = global_reactor();
+  if (r->vtable)
+    r->vtable->cleanup(r->data);
+  *r = (Reactor){0};
+}
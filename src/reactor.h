@@ -0,0 +1,74 @@
+#ifndef __REACTOR_H__
+#define __REACTOR_H__
+
+#include "async.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+// how many calls to reactor_tick() pass between non-blocking polls
+#ifndef REACTOR_TICK_INTERVAL
+#define REACTOR_TICK_INTERVAL 64
+#endif
+
+#ifndef REACTOR_EVENTS
+#define REACTOR_EVENTS 64
+#endif
+
+// Deadlines are absolute, see timer_deadline, and 0 waits for as long as it
+// takes. Running into one fails with ETIMEDOUT.
+typedef bool WaitFd(void *, int fd, uint32_t events, uint64_t deadline);
+typedef int Recv(void *, int fd, char *buf, int n, int flags,
+                 uint64_t deadline);
+typedef int Send(void *, int fd, char *buf, int n, int flags,
+                 uint64_t deadline);
+typedef int Accept(void *, int fd, struct sockaddr *addr, socklen_t *addr_len,
+                   uint64_t deadline);
+// Regular files are always ready as far as epoll is concerned, so these
+// complete through io_uring or on the blocking pool instead.
+typedef ssize_t ReadAt(void *, int fd, void *buf, size_t n, off_t off);
+typedef ssize_t WriteAt(void *, int fd, const void *buf, size_t n, off_t off);
+typedef int Fsync(void *, int fd);
+typedef int Close(void *, int fd);
+typedef int Poll(void *, int timeout_ms);
+typedef int Pending(void *);
+typedef void ReactorCleanup(void *);
+
+typedef struct {
+  WaitFd *wait_fd;
+  Recv *recv;
+  Send *send;
+  Accept *accept;
+  ReadAt *pread;
+  WriteAt *pwrite;
+  Fsync *fsync;
+  Close *close;
+  Poll *poll;       // wakes up tasks whose I/O is done, returns their amount
+  Pending *pending; // amount of tasks parked in the reactor
+  ReactorCleanup *cleanup;
+} ReactorVTable;
+
+typedef struct {
+  void *data;
+  ReactorVTable *vtable;
+  int ticks;
+} Reactor;
+
+Reactor *global_reactor();
+
+void use_epoll_reactor();
+bool use_uring_reactor();
+
+// parks the current task until fd is ready for events (EPOLLIN or EPOLLOUT)
+void await_fd(int fd, uint32_t events);
+// same, but returns false if deadline passed first
+bool await_fd_until(int fd, uint32_t events, uint64_t deadline);
+
+int reactor_poll(int timeout_ms);
+int reactor_pending();
+bool reactor_wait();
+void reactor_tick();
+void reactor_deinit();
+
+#endif // !__REACTOR_H__
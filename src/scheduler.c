@@ -1,132 +1,845 @@
+#define _GNU_SOURCE
 #include "scheduler.h"
 #include "async.h"
 #include "dbg.h"
+#include "reactor.h"
+#include "stack.h"
+#include "switch.h"
 #include <assert.h>
+#include <errno.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 
-Handle start_new_task(AsyncFunction *fn, void *data) {
+static Task *alloc_task(Handle *out) {
   TaskPool *pool = global_pool();
   Handle h = {.idx = 0};
+  Task *t = NULL;
   if (pool->free_task.idx == 0) {
-
-    if (pool->len == pool->cap) {
-      pool->cap = pool->cap * 2 + 10;
-      pool->tasks = realloc(pool->tasks, pool->cap * sizeof(Task));
-      assert(pool->tasks);
+    if (!pool->chunks) {
+      pool->chunks = calloc(TASK_MAX_CHUNKS, sizeof(TaskChunk *));
+      assert(pool->chunks);
     }
-
-    void *stack_base =
-        mmap(NULL, STACK_SIZE, PROT_READ | PROT_WRITE,
-             MAP_PRIVATE | MAP_STACK | MAP_GROWSDOWN | MAP_ANONYMOUS, -1, 0);
-    if (stack_base == MAP_FAILED) {
-      perror("mmap: ");
-      exit(1);
+    int chunk = pool->len >> TASK_CHUNK_SHIFT;
+    assert(chunk < TASK_MAX_CHUNKS && "too many tasks");
+    if (!pool->chunks[chunk]) {
+      // hot array first, starting on a cache line
+      size_t size = (sizeof(TaskChunk) + 63) & ~(size_t)63;
+      pool->chunks[chunk] = aligned_alloc(64, size);
+      assert(pool->chunks[chunk]);
     }
-
-    Task *new_task = &pool->tasks[pool->len];
     pool->len++;
+    t = task_at(pool->len);
     h.idx = pool->len;
-    new_task->stack_base = stack_base;
-    new_task->stack_ptr = stack_base + STACK_SIZE;
-    new_task->fn = fn;
-    new_task->data = data;
-    new_task->state = INIT;
-    new_task->orphaned = false;
-    new_task->handle = h;
+    hot_at(h.idx)->gen = 1;
+    t->transferred = false;
+    t->waiters = NULL;
+    t->inline_call = NULL;
+    t->saved = NULL;
+    t->saved_cap = 0;
+    t->timer = (Timer){0};
   } else {
     h = pool->free_task;
-    assert(h.idx > 0);
-    assert(h.idx <= pool->len);
-    Task *t = &pool->tasks[h.idx - 1];
-    assert(t->state == FREE);
-    assert(t->stack_base);
+    t = task_at(h.idx);
+    assert(hot_at(h.idx)->state == FREE);
     pool->free_task = t->handle;
+  }
+  h.gen = hot_at(h.idx)->gen;
+  t->orphaned = false;
+  t->priority = 0;
+  t->base_priority = 0;
+  t->awaiting = NULL;
+  Handle spawner = current_task_handle();
+  t->group = spawner.idx ? task_at(spawner.idx)->group : 0;
+  link_at(h.idx)->prev = -1;
+  *out = h;
+  return t;
+}
 
-    t->state = INIT;
-    t->handle = h;
-    t->fn = fn;
-    t->data = data;
-    t->stack_ptr = t->stack_base + STACK_SIZE;
+// Allocates a task without handing it to the scheduler.
+Handle create_task(AsyncFunction *fn, void *data, size_t stack_size) {
+  TaskPool *pool = global_pool();
+  Handle h;
+  Task *t = alloc_task(&h);
+  t->stackless = false;
+  if (pool->shared.base) {
+    t->stack_size = pool->shared.size;
+    t->stack_base = pool->shared.base;
+  } else {
+    if (!stack_size)
+      stack_size = stack_profile_size(&pool->profile, fn);
+    t->stack_size = stack_size ? stack_size : STACK_SIZE;
+    t->stack_base = stack_alloc(&pool->stacks, &t->stack_size);
+    if (pool->profile.enabled)
+      stack_paint(t->stack_base, t->stack_size);
   }
+  t->saved_len = 0;
+  TaskHot *hot = hot_at(h.idx);
+  hot->stack_ptr = t->stack_base + t->stack_size;
+  hot->state = INIT;
+  t->handle = h;
+  t->fn = fn;
+  t->data = data;
+  return h;
+}
+
+// A task without a stack of its own, fn is a PtFunction and data its Pt.
+Handle create_stackless_task(AsyncFunction *fn, void *data) {
+  Handle h;
+  Task *t = alloc_task(&h);
+  t->stackless = true;
+  t->stack_base = NULL;
+  t->stack_size = 0;
+  t->saved_len = 0;
+  TaskHot *hot = hot_at(h.idx);
+  hot->stack_ptr = NULL;
+  hot->state = INIT;
+  t->handle = h;
+  t->fn = fn;
+  t->data = data;
+  return h;
+}
 
+Handle start_new_task(AsyncFunction *fn, void *data, const CallOptions *opts) {
+  Handle h = create_task(fn, data, opts ? opts->stack_size : 0);
+  if (opts) {
+    assert(opts->priority >= 0 && opts->priority < ASYNC_PRIORITIES);
+    task_at(h.idx)->priority = opts->priority;
+    task_at(h.idx)->base_priority = opts->priority;
+    if (opts->group) {
+      assert(opts->group < global_pool()->groups_len && "unknown group");
+      task_at(h.idx)->group = opts->group;
+    }
+  }
   Scheduler *scheduler = global_scheduler();
-  scheduler->vtable->register_task(scheduler->data, h);
+  SCHED_CALL(scheduler, register_task, scheduler->data, h);
   return h;
 }
 
+static TaskChunk *chunk_at(int idx) {
+  TaskPool *p = global_pool();
+  assert(idx > 0);
+  assert(idx <= p->len);
+  return p->chunks[(idx - 1) >> TASK_CHUNK_SHIFT];
+}
+
+Task *task_at(int idx) {
+  return &chunk_at(idx)->cold[(idx - 1) & (TASK_CHUNK_SIZE - 1)];
+}
+
+TaskHot *hot_at(int idx) {
+  return &chunk_at(idx)->hot[(idx - 1) & (TASK_CHUNK_SIZE - 1)];
+}
+
+RunLink *link_at(int idx) {
+  return &chunk_at(idx)->link[(idx - 1) & (TASK_CHUNK_SIZE - 1)];
+}
+
+TaskHot *get_hot(Handle h) {
+  TaskHot *hot = hot_at(h.idx);
+  assert(hot->gen == h.gen && "stale handle");
+  return hot;
+}
+
 Task *get_task(Handle h) {
-  assert(h.idx > 0);
-  assert(h.idx <= global_pool()->len);
-  return &global_pool()->tasks[h.idx - 1];
+  get_hot(h);
+  return task_at(h.idx);
+}
+
+Handle task_handle(int idx) {
+  return (Handle){.idx = idx, .gen = hot_at(idx)->gen};
+}
+
+static RunLink *pool_link(TaskPool *p, int idx) {
+  assert(idx > 0 && idx <= p->len);
+  return &p->chunks[(idx - 1) >> TASK_CHUNK_SHIFT]
+              ->link[(idx - 1) & (TASK_CHUNK_SIZE - 1)];
+}
+
+bool run_queued(int idx) { return link_at(idx)->prev >= 0; }
+
+void run_queue_init(RunQueue *q) { *q = (RunQueue){.pool = global_pool()}; }
+
+void run_queue_push_back(RunQueue *q, int idx) {
+  TaskPool *p = q->pool;
+  RunLink *l = pool_link(p, idx);
+  assert(l->prev < 0);
+  l->prev = q->tail;
+  l->next = 0;
+  if (q->tail)
+    pool_link(p, q->tail)->next = idx;
+  else
+    q->head = idx;
+  q->tail = idx;
+  q->len++;
+}
+
+void run_queue_push_front(RunQueue *q, int idx) {
+  TaskPool *p = q->pool;
+  RunLink *l = pool_link(p, idx);
+  assert(l->prev < 0);
+  l->prev = 0;
+  l->next = q->head;
+  if (q->head)
+    pool_link(p, q->head)->prev = idx;
+  else
+    q->tail = idx;
+  q->head = idx;
+  q->len++;
+}
+
+void run_queue_remove(RunQueue *q, int idx) {
+  TaskPool *p = q->pool;
+  RunLink *l = pool_link(p, idx);
+  assert(l->prev >= 0);
+  if (l->prev)
+    pool_link(p, l->prev)->next = l->next;
+  else
+    q->head = l->next;
+  if (l->next)
+    pool_link(p, l->next)->prev = l->prev;
+  else
+    q->tail = l->prev;
+  l->prev = -1;
+  q->len--;
+}
+
+// Moves the head to the back, what a yield does.
+void run_queue_rotate(RunQueue *q) {
+  int idx = q->head;
+  assert(idx && "Underflow");
+  if (idx == q->tail)
+    return;
+  TaskPool *p = q->pool;
+  RunLink *l = pool_link(p, idx);
+  q->head = l->next;
+  pool_link(p, q->head)->prev = 0;
+  pool_link(p, q->tail)->next = idx;
+  l->prev = q->tail;
+  l->next = 0;
+  q->tail = idx;
+}
+
+int run_queue_pop_front(RunQueue *q) {
+  int idx = q->head;
+  assert(idx && "Underflow");
+  run_queue_remove(q, idx);
+  return idx;
 }
 
 State poll_state(Handle h) {
   Scheduler *s = global_scheduler();
-  Handle cur = current_task_handle();
-  s->vtable->poll_task(s->data, h);
-  Task *t = get_task(h);
-  return t->state;
+  return SCHED_CALL(s, poll_task, s->data, h);
 }
 
 void wait_ready(Handle h) {
   Scheduler *s = global_scheduler();
-  s->vtable->wait_ready(s->data, h);
+  SCHED_CALL(s, wait_ready, s->data, h);
 }
 
 void free_task(Handle h) {
   Scheduler *s = global_scheduler();
   TaskPool *p = global_pool();
-  assert(h.idx);
-  s->vtable->free_task(s->data, h);
+  TaskHot *hot = get_hot(h);
+  Task *t = task_at(h.idx);
+  SCHED_CALL(s, free_task, s->data, h);
 
-  Task *t = get_task(h);
-  t->state = FREE;
+  hot->state = FREE;
+  hot->gen++; // h and its copies are stale from here on
   t->handle = p->free_task;
   p->free_task = h;
+  if (p->shared.base) {
+    // whatever is left on the shared stack is garbage now
+    if (p->shared.occupant == h.idx)
+      p->shared.occupant = 0;
+    free(t->saved);
+    t->saved = NULL;
+    t->saved_cap = 0;
+  } else if (!t->stackless) {
+    // this may be the stack we are running on, the pool holds on to it until
+    // the next allocation
+    stack_free(&p->stacks, t->stack_base, t->stack_size);
+  }
+  t->stack_base = NULL;
+  hot->stack_ptr = NULL;
 }
 
 void finish_current_task(Handle *finished_task, Handle *next_task) {
   Scheduler *s = global_scheduler();
-  s->vtable->finish_task(s->data, finished_task, next_task);
+  SCHED_CALL(s, finish_task, s->data, finished_task, next_task);
 }
 
 Handle current_task_handle() {
   Scheduler *s = global_scheduler();
-  return s->vtable->current_task(s->data);
+  return SCHED_CALL(s, current_task, s->data);
 }
 
 Handle next_task_handle() {
   Scheduler *s = global_scheduler();
-  return s->vtable->next_task(s->data);
+  reactor_tick();
+  return SCHED_CALL(s, next_task, s->data);
+}
+
+static void park_for(Handle next) {
+  Scheduler *s = global_scheduler();
+  Handle current = {0};
+  SCHED_CALL(s, park_task, s->data, &current, &next);
+  get_hot(current)->state = PARKED;
+  if (next.idx == 0)
+    next = wait_runnable_task();
+  if (next.idx != current.idx)
+    async_switch(current, next);
+}
+
+// Takes the current task out of the run queue until someone calls wake_task
+// on it, and runs something else in the meantime.
+void park_current_task() { park_for((Handle){0}); }
+
+void wake_task(Handle h) {
+  Scheduler *s = global_scheduler();
+  TaskHot *hot = get_hot(h);
+  assert(hot->state == PARKED);
+  hot->state = RUNNING;
+  SCHED_CALL(s, wake_task, s->data, h);
+}
+
+// Operations left before the running task has to yield, refilled on every
+// switch.
+static _Thread_local int coop_left __attribute__((tls_model("initial-exec")));
+
+void coop_refill() { coop_left = current_runtime()->coop_budget; }
+
+// Takes one operation off the running task's budget and yields once it is
+// used up. Awaits and socket calls that never had to wait would otherwise
+// keep the thread to themselves.
+void coop_charge() {
+  if (coop_left <= 0 || --coop_left > 0)
+    return;
+  Handle current = current_task_handle();
+  Handle next = next_task_handle();
+  if (current.idx != next.idx)
+    async_switch(current, next);
+  coop_refill();
+}
+
+// Preemption: while the running task is inside async_preemptible_begin/end,
+// a per-thread timer sends it PREEMPT_SIGNAL every RuntimeOptions.preempt_us
+// and the handler yields right there, from the middle of whatever the task
+// was computing. Only the region flag says that is safe. Ticks that land
+// while the thread is inside the runtime leave preempt_pending behind instead.
+#define PREEMPT_SIGNAL SIGURG
+
+static _Thread_local int runtime_depth
+    __attribute__((tls_model("initial-exec")));
+static _Thread_local int preempt_region
+    __attribute__((tls_model("initial-exec")));
+static _Thread_local volatile sig_atomic_t preempt_pending
+    __attribute__((tls_model("initial-exec")));
+
+static void preempt_arm(long us) {
+  Runtime *rt = current_runtime();
+  if (!rt->preempt_us)
+    return;
+  struct itimerspec slice = {0};
+  if (us) {
+    slice.it_value = (struct timespec){us / 1000000, us % 1000000 * 1000};
+    slice.it_interval = slice.it_value;
+  }
+  timer_settime(rt->preempt_timer, 0, &slice, NULL);
+}
+
+static void on_preempt(int sig) {
+  if (!preempt_region)
+    return;
+  if (runtime_depth) {
+    preempt_pending = 1;
+    return;
+  }
+  int saved = errno;
+  runtime_lock();
+  // the slice went to computing, tasks waiting for I/O should not also have
+  // to wait for REACTOR_TICK_INTERVAL more switches to be noticed
+  if (reactor_pending())
+    reactor_poll(0);
+  Handle current = current_task_handle();
+  Handle next = next_task_handle();
+  if (current.idx != next.idx)
+    async_switch(current, next);
+  runtime_unlock();
+  errno = saved;
+}
+
+static void preempt_init(long us) {
+  Runtime *rt = current_runtime();
+  // SA_NODEFER: the handler switches away and other tasks must still get
+  // ticks before it returns
+  struct sigaction sa = {.sa_handler = on_preempt,
+                         .sa_flags = SA_NODEFER | SA_RESTART};
+  sigemptyset(&sa.sa_mask);
+  struct sigevent ev = {.sigev_notify = SIGEV_THREAD_ID,
+                        .sigev_signo = PREEMPT_SIGNAL};
+  ev._sigev_un._tid = gettid(); // sigev_notify_thread_id, not in glibc headers
+  if (sigaction(PREEMPT_SIGNAL, &sa, NULL) == -1 ||
+      timer_create(CLOCK_MONOTONIC, &ev, &rt->preempt_timer) == -1) {
+    perror("preemption timer");
+    exit(1);
+  }
+  rt->preempt_us = us;
+}
+
+static void preempt_deinit() {
+  Runtime *rt = current_runtime();
+  if (rt->preempt_us)
+    timer_delete(rt->preempt_timer);
+  rt->preempt_us = 0;
+  runtime_depth = 0;
+  preempt_region = 0;
+}
+
+// Called by async_switch around the switch: the region belongs to the task,
+// its timer only runs while the task does.
+int preempt_save() {
+  int region = preempt_region;
+  if (region) {
+    preempt_region = 0;
+    preempt_arm(0);
+  }
+  preempt_pending = 0;
+  return region;
+}
+
+void preempt_restore(int region) {
+  if (region) {
+    preempt_region = region;
+    preempt_arm(current_runtime()->preempt_us);
+  }
+}
+
+void preempt_begin() {
+  assert(!preempt_region && "preemptible regions do not nest");
+  preempt_pending = 0;
+  preempt_region = 1;
+  preempt_arm(current_runtime()->preempt_us);
+}
+
+void preempt_end() {
+  assert(preempt_region);
+  preempt_region = 0;
+  preempt_arm(0);
+  if (!preempt_pending)
+    return;
+  preempt_pending = 0;
+  Handle current = current_task_handle();
+  Handle next = next_task_handle();
+  if (current.idx != next.idx)
+    async_switch(current, next);
+}
+
+static void apply_priority(Handle h, int priority) {
+  Scheduler *s = global_scheduler();
+  Task *t = get_task(h);
+  if (t->priority == priority)
+    return;
+  SCHED_CALL(s, set_priority, s->data, h, priority);
+  t->priority = priority;
+}
+
+// The handles a parked task waits on are on its stack. On the shared stack
+// that is the copy in saved, unless the task was the last one to use it.
+static Handle *awaited_by(Handle h) {
+  Task *t = get_task(h);
+  SharedStack *s = &global_pool()->shared;
+  if (!shared_stack_contains(s, t->awaiting) || s->occupant == h.idx)
+    return t->awaiting;
+  char *saved_from = s->base + s->size - t->saved_len;
+  return (Handle *)(t->saved + ((char *)t->awaiting - saved_from));
+}
+
+// Lends priority to h and everything it is waiting for, down the chain.
+static void lend_priority(Handle h, int priority) {
+  Task *t = get_task(h);
+  if (t->priority >= priority)
+    return;
+  apply_priority(h, priority);
+  if (!t->awaiting)
+    return;
+  Handle *awaited = awaited_by(h);
+  for (int i = 0; i < t->awaiting_len; i++) {
+    if (get_hot(awaited[i])->state != READY)
+      lend_priority(awaited[i], priority);
+  }
+}
+
+// Recomputes h's priority from its own and what the tasks waiting for it
+// lend, and passes a change on to whatever h is waiting for.
+static void settle_priority(Handle h) {
+  Task *t = get_task(h);
+  int priority = t->base_priority;
+  for (Waiter *w = t->waiters; w; w = w->next) {
+    Task *waiter = get_task(w->task);
+    if (waiter->latch > 0 && waiter->priority > priority)
+      priority = waiter->priority;
+  }
+  if (priority == t->priority)
+    return;
+  apply_priority(h, priority);
+  if (!t->awaiting)
+    return;
+  Handle *awaited = awaited_by(h);
+  for (int i = 0; i < t->awaiting_len; i++) {
+    if (get_hot(awaited[i])->state != READY)
+      settle_priority(awaited[i]);
+  }
+}
+
+void set_task_priority(Handle h, int priority) {
+  assert(priority >= 0 && priority < ASYNC_PRIORITIES);
+  get_task(h)->base_priority = priority;
+  settle_priority(h);
+}
+
+int create_group(unsigned weight) {
+  TaskPool *p = global_pool();
+  assert(weight > 0);
+  if (p->groups_len == 0) {
+    p->groups = malloc(sizeof(TaskGroup));
+    assert(p->groups);
+    p->groups[0] = (TaskGroup){.weight = ASYNC_GROUP_DEFAULT_WEIGHT};
+    p->groups_len = 1;
+  }
+  p->groups = realloc(p->groups, (p->groups_len + 1) * sizeof(TaskGroup));
+  assert(p->groups);
+  p->groups[p->groups_len] = (TaskGroup){.weight = weight};
+  return p->groups_len++;
+}
+
+void set_group_cap(int group, int percent) {
+  TaskPool *p = global_pool();
+  assert(group > 0 && group < p->groups_len);
+  assert(percent >= 0 && percent <= 100);
+  p->groups[group].cap = percent;
+}
+
+TaskGroup group_at(int group) {
+  TaskPool *p = global_pool();
+  if (group == 0 && p->groups_len == 0)
+    return (TaskGroup){.weight = ASYNC_GROUP_DEFAULT_WEIGHT};
+  assert(group >= 0 && group < p->groups_len);
+  return p->groups[group];
+}
+
+static void add_waiter(Task *other, Handle task, int idx) {
+  TaskPool *p = global_pool();
+  Waiter *w = p->free_waiters;
+  if (w) {
+    p->free_waiters = w->next;
+  } else {
+    w = malloc(sizeof(Waiter));
+    assert(w);
+  }
+  w->task = task;
+  w->idx = idx;
+  w->next = other->waiters;
+  other->waiters = w;
+}
+
+static void remove_waiter(Task *other, Handle task) {
+  TaskPool *p = global_pool();
+  for (Waiter **w = &other->waiters; *w;) {
+    if ((*w)->task.idx == task.idx) {
+      Waiter *removed = *w;
+      *w = removed->next;
+      removed->next = p->free_waiters;
+      p->free_waiters = removed;
+    } else {
+      w = &(*w)->next;
+    }
+  }
+}
+
+// Parks the current task until count of the tasks in handles finish and
+// returns the position of the first one that did. The caller has to make
+// sure that at least count of them are not READY yet.
+int wait_tasks(Handle *handles, int len, int count) {
+  return wait_tasks_until(handles, len, count, 0);
+}
+
+static void tasks_timed_out(Handle task, long arg) {
+  task_at(task.idx)->latch = 0;
+  wake_task(task);
+}
+
+// Same as wait_tasks, but gives up at deadline (0 for never) and returns -1.
+int wait_tasks_until(Handle *handles, int len, int count, uint64_t deadline) {
+  Handle current = current_task_handle();
+  Task *t = get_task(current);
+  assert(count > 0);
+  t->latch = count;
+  t->woken_idx = -1;
+
+  int waiting = 0;
+  for (int i = 0; i < len; i++) {
+    if (get_hot(handles[i])->state == READY)
+      continue;
+    add_waiter(task_at(handles[i].idx), current, i);
+    // whatever we wait for runs at least at our priority
+    lend_priority(handles[i], t->priority);
+    waiting++;
+  }
+  assert(waiting >= count);
+  t->awaiting = handles;
+  t->awaiting_len = len;
+
+  if (deadline)
+    timer_start(deadline, tasks_timed_out, 0);
+  park_current_task();
+  t = get_task(current);
+  t->awaiting = NULL;
+  bool expired = deadline && timer_stop();
+  if (expired || waiting > count) {
+    // the tasks that are still running must not wake us up later, nor keep
+    // what we lent them
+    for (int i = 0; i < len; i++) {
+      if (get_hot(handles[i])->state == READY)
+        continue;
+      remove_waiter(get_task(handles[i]), current);
+      settle_priority(handles[i]);
+    }
+  }
+  return expired ? -1 : t->woken_idx;
+}
+
+// Parks the current task until a task transfers back to it or to finishes.
+// If to was parked in a transfer as well, it runs right away in the current
+// task's place, otherwise it keeps its place in the run queue.
+void transfer_current_task(Handle to) {
+  Handle current = current_task_handle();
+  Task *t = get_task(to);
+  Task *cur = get_task(current);
+  assert(to.idx != current.idx);
+  TaskHot *hot = get_hot(to);
+  assert(hot->state != READY && hot->state != FREE);
+  Handle next = {0};
+  if (hot->state == PARKED && t->transferred) {
+    t->transferred = false;
+    hot->state = RUNNING;
+    next = to;
+  }
+  cur->latch = 1;
+  cur->woken_idx = -1;
+  add_waiter(t, current, 0);
+  cur->transferred = true;
+  park_for(next);
+
+  cur = get_task(current);
+  cur->transferred = false;
+  if (cur->latch) {
+    // a transfer brought us back, not to finishing
+    cur->latch = 0;
+    remove_waiter(get_task(to), current);
+  }
+}
+
+void wake_waiters(Handle h) {
+  TaskPool *p = global_pool();
+  Task *t = get_task(h);
+  for (Waiter *w = t->waiters; w;) {
+    Waiter *next = w->next;
+    Task *waiter = get_task(w->task);
+    if (waiter->latch > 0) {
+      if (waiter->woken_idx == -1)
+        waiter->woken_idx = w->idx;
+      if (--waiter->latch == 0)
+        wake_task(w->task);
+    }
+    w->next = p->free_waiters;
+    p->free_waiters = w;
+    w = next;
+  }
+  t->waiters = NULL;
+}
+
+// If the only task waiting for h waits for nothing else, wakes it without
+// going through the run queue and returns it, so the finishing task can hand
+// it its place.
+Handle take_sole_waiter(Handle h) {
+  TaskPool *p = global_pool();
+  Task *t = get_task(h);
+  Waiter *w = t->waiters;
+  if (!w || w->next)
+    return (Handle){0};
+  Task *waiter = get_task(w->task);
+  if (waiter->latch != 1)
+    return (Handle){0};
+  waiter->latch = 0;
+  if (waiter->woken_idx == -1)
+    waiter->woken_idx = w->idx;
+  TaskHot *hot = get_hot(w->task);
+  assert(hot->state == PARKED);
+  hot->state = RUNNING;
+  Handle next = w->task;
+  t->waiters = NULL;
+  w->next = p->free_waiters;
+  p->free_waiters = w;
+  return next;
+}
+
+// Records how deep the finished task h went into its stack.
+void measure_stack(Handle h) {
+  TaskPool *p = global_pool();
+  Task *t = get_task(h);
+  if (!p->profile.enabled || t->stackless)
+    return;
+  stack_profile_record(&p->profile, t->fn,
+                       stack_used(t->stack_base, t->stack_size));
+}
+
+// Returns the task at the front of the run queue, blocking in the reactor
+// while the queue is empty.
+Handle wait_runnable_task() {
+  Handle next = current_task_handle();
+  while (next.idx == 0) {
+    if (!reactor_wait()) {
+      fprintf(stderr, "deadlock: no runnable or parked tasks left\n");
+      abort();
+    }
+    next = current_task_handle();
+  }
+  return next;
 }
 
 void async_deinit() {
   Scheduler *s = global_scheduler();
   TaskPool *p = global_pool();
-  s->vtable->cleanup(s->data);
+  SCHED_CALL(s, cleanup, s->data);
+  preempt_deinit();
+  reactor_deinit();
+  blocking_deinit();
+  switch_deinit();
 
-  for (int i = 0; i < p->len; i++) {
-    Task *t = &p->tasks[i];
-    // if (munmap(t->stack_base, STACK_SIZE) == -1) {
-    //   perror("munmap");
-    // }
+  stack_pool_deinit(&p->stacks);
+  shared_stack_deinit(&p->shared);
+  stack_profile_deinit(&p->profile);
+  for (int i = 1; i <= p->len; i++) {
+    Task *t = task_at(i);
+    free(t->saved);
+    for (Waiter *w = t->waiters; w;) {
+      Waiter *next = w->next;
+      free(w);
+      w = next;
+    }
   }
-  free(p->tasks);
+  for (Waiter *w = p->free_waiters; w;) {
+    Waiter *next = w->next;
+    free(w);
+    w = next;
+  }
+  if (p->chunks) {
+    for (int i = 0; i < TASK_MAX_CHUNKS && p->chunks[i]; i++)
+      free(p->chunks[i]);
+    free(p->chunks);
+  }
+  free(p->groups);
   *p = (TaskPool){0};
 }
 
-static Scheduler scheduler = {0};
-static TaskPool pool = {0};
+static Runtime main_runtime = {0};
+static _Thread_local Runtime *runtime
+    __attribute__((tls_model("initial-exec"))) = NULL;
+
+Runtime *current_runtime() { return runtime ? runtime : &main_runtime; }
 
-Scheduler *global_scheduler() { return &scheduler; }
+void set_current_runtime(Runtime *rt) { runtime = rt; }
 
-TaskPool *global_pool() { return &pool; }
+Scheduler *global_scheduler() { return &current_runtime()->scheduler; }
+
+TaskPool *global_pool() { return &current_runtime()->pool; }
+
+void runtime_lock() {
+  runtime_reacquire();
+  runtime_depth++;
+}
+
+void runtime_unlock() {
+  runtime_depth--;
+  runtime_release();
+}
+
+// Lets go of the lock for a blocking call, the thread stays inside the
+// runtime as far as preemption is concerned.
+void runtime_release() {
+  Scheduler *s = global_scheduler();
+  if (s->lock)
+    pthread_mutex_unlock(s->lock);
+}
 
-void async_init() {
-  // use_queue_scheduler();
-  use_graph_scheduler();
+void runtime_reacquire() {
+  Scheduler *s = global_scheduler();
+  if (s->lock)
+    pthread_mutex_lock(s->lock);
+}
+
+void async_init(const RuntimeOptions *opts) {
+  int budget = opts->coop_budget ? opts->coop_budget : ASYNC_COOP_BUDGET;
+  current_runtime()->coop_budget = budget > 0 ? budget : 0;
+  timer_wheel_init(&current_runtime()->timers);
+  SchedulerKind kind = opts->scheduler;
+#ifdef ASYNC_SCHEDULER
+  kind = SCHED_FN(ASYNC_SCHEDULER, scheduler_kind);
+  // SCHEDULER_GRAPH is also what options that leave it unset ask for
+  if (opts->scheduler != SCHEDULER_GRAPH && opts->scheduler != kind)
+    fprintf(stderr, "built for another scheduler, ignoring the one asked\n");
+#endif
+  if (opts->preempt_us > 0 && kind == SCHEDULER_STEAL) {
+    fprintf(stderr, "preemption is single threaded, ignoring it\n");
+  } else if (opts->preempt_us > 0) {
+    preempt_init(opts->preempt_us);
+  }
+  size_t warm = opts->stack_warm_pool ? opts->stack_warm_pool : STACK_WARM_POOL;
+  stack_pool_init(&global_pool()->stacks, warm, !opts->no_stack_guard,
+                  opts->stack_huge_pages);
+  if (opts->shared_stack_size && kind == SCHEDULER_STEAL) {
+    fprintf(stderr, "shared stacks are single threaded, ignoring them\n");
+  } else if (opts->shared_stack_size) {
+    shared_stack_init(&global_pool()->shared, opts->shared_stack_size);
+  }
+  // painting a shared stack would only ever measure all tasks at once
+  if (!global_pool()->shared.base) {
+    stack_profile_init(&global_pool()->profile, opts->stack_stats,
+                       opts->stack_auto_size);
+  }
+
+  // the reactor goes first, worker threads start polling it immediately
+  if (opts->io_backend == IO_URING && kind == SCHEDULER_STEAL) {
+    fprintf(stderr, "io_uring is single threaded, falling back to epoll\n");
+    use_epoll_reactor();
+  } else if (opts->io_backend == IO_URING && !use_uring_reactor()) {
+    fprintf(stderr, "io_uring is unavailable, falling back to epoll\n");
+    use_epoll_reactor();
+  } else if (opts->io_backend != IO_URING) {
+    use_epoll_reactor();
+  }
+
+  switch (kind) {
+  case SCHEDULER_QUEUE:
+    use_queue_scheduler();
+    break;
+  case SCHEDULER_STEAL:
+    use_steal_scheduler(opts->threads);
+    break;
+  case SCHEDULER_PRIORITY:
+    use_priority_scheduler();
+    break;
+  case SCHEDULER_FAIR:
+    use_fair_scheduler();
+    break;
+  default:
+    use_graph_scheduler();
+    break;
+  }
 }
@@ -2,32 +2,125 @@
 #define __SCHEDULER_H__
 
 #include "async.h"
+#include "blocking.h"
+#include "reactor.h"
+#include "stack.h"
+#include "timer.h"
 #include "stdbool.h"
+#include <pthread.h>
+#include <setjmp.h>
+#include <time.h>
 
 typedef enum {
   INIT,    // coroutine was just created
   READY,   // coroutine has finished
   RUNNING, // coroutine is in progress
   FREE,    // freed coroutine, should be unreachable
+  PARKED,  // coroutine is waiting for an event outside of the run queue
 } State;
 
+// A task parked until some other tasks finish. Nodes are pooled instead of
+// living on the waiting task's stack, so finishing tasks can always reach them.
+typedef struct Waiter {
+  struct Waiter *next;
+  Handle task; // who is waiting
+  int idx;     // position of the awaited handle in the waiter's list
+} Waiter;
+
+// A function run by await_call on the stack of the calling task. Its
+// async_return jumps back to the caller instead of finishing the task.
+typedef struct InlineCall {
+  struct InlineCall *prev; // the call this one is nested in
+  jmp_buf env;
+  void *result;
+} InlineCall;
+
+// What switching and polling touch, kept apart from the rest of the task so
+// that four of them share a cache line.
 typedef struct {
-  void *stack_base;
   void *stack_ptr;
+  unsigned gen; // bumped whenever the task is freed
+  State state;
+} TaskHot;
+
+typedef struct {
+  void *stack_base; // lowest usable address, NULL once freed
+  size_t stack_size;
+  char *saved; // frames copied off the shared stack while switched out
+  size_t saved_len;
+  size_t saved_cap;
   AsyncFunction *fn;
   void *data;
-  State state;
   bool orphaned;
-  Handle handle; // if state is FREE, this points to the next free task
+  bool transferred; // parked in async_transfer until a task transfers back
+  bool stackless;   // a PtFunction, runs on the thread's stackless host stack
+  Handle handle;   // if state is FREE, this points to the next free task
+  Waiter *waiters; // tasks to wake up once this one finishes
+  InlineCall *inline_call; // innermost await_call in progress
+  int latch;       // amount of awaited tasks that have to finish to wake this
+  int woken_idx;   // idx of the first awaited task that finished
+  int priority;      // base_priority or more while a waiter lends its own
+  int base_priority; // from CallOptions or async_set_priority
+  Handle *awaiting;  // on the task's stack while it is parked in wait_tasks
+  int awaiting_len;
+  int group; // see async_group_create
+  Timer timer;
 } Task;
 
+// Links of a task in a RunQueue, neighbours are task indices and 0 at either
+// end. prev is -1 while the task is not queued.
 typedef struct {
-  Task *tasks;
-  int len;
-  int cap;
+  int prev, next;
+} RunLink;
+
+// Tasks live in fixed size chunks that never move, so a Task * stays valid
+// while other tasks are created and growing the table copies nothing. Each
+// chunk keeps the hot halves of its tasks in one dense array.
+#ifndef TASK_CHUNK_SHIFT
+#define TASK_CHUNK_SHIFT 10
+#endif
+#define TASK_CHUNK_SIZE (1 << TASK_CHUNK_SHIFT)
+
+#ifndef TASK_MAX_CHUNKS
+#define TASK_MAX_CHUNKS (1 << 16) // 64M tasks
+#endif
+
+typedef struct {
+  TaskHot hot[TASK_CHUNK_SIZE];
+  RunLink link[TASK_CHUNK_SIZE];
+  Task cold[TASK_CHUNK_SIZE];
+} TaskChunk;
+
+typedef struct {
+  unsigned weight;
+  int cap; // percent of the CPU, 0 if uncapped
+} TaskGroup;
+
+typedef struct {
+  TaskChunk **chunks; // TASK_MAX_CHUNKS entries, allocated on first use
+  int len;       // slots handed out so far
   Handle free_task; // handle of the first free task
+  Waiter *free_waiters;
+  StackPool stacks;
+  SharedStack shared;
+  StackProfile profile;
+  Handle main_task; // exits the process once it returns
+  TaskGroup *groups; // group 0 is implicit until the first group is created
+  int groups_len;
 } TaskPool;
 
+// A run queue threaded through the RunLink of each task. Pushing, popping and
+// unlinking from the middle are O(1) and never allocate; a task can be in at
+// most one of them.
+typedef struct {
+  int head, tail; // task indices, 0 when empty
+  int len;
+  TaskPool *pool; // whose tasks are linked, saves a thread local lookup
+} RunQueue;
+
+// FinishTask and ParkTask take the current task off the head of the run
+// queue and return the task to run next. If next is set on entry, it is a
+// parked task that takes the place of the current one instead.
 typedef void RegisterTask(void *, Handle);
 typedef void FinishTask(void *, Handle *, Handle *);
 typedef void FreeTask(void *, Handle);
@@ -35,6 +128,9 @@ typedef State PollTask(void *, Handle pollee);
 typedef void WaitReady(void *, Handle);
 typedef Handle CurrentTask(void *);
 typedef Handle NextTask(void *);
+typedef void ParkTask(void *, Handle *, Handle *);
+typedef void WakeTask(void *, Handle);
+typedef void SetPriority(void *, Handle, int);
 typedef void Cleanup(void *);
 
 typedef struct {
@@ -45,29 +141,121 @@ typedef struct {
   WaitReady *wait_ready;
   CurrentTask *current_task;
   NextTask *next_task;
+  ParkTask *park_task;
+  WakeTask *wake_task;
+  SetPriority *set_priority; // called before Task.priority changes
   Cleanup *cleanup;
 } SchedulerVTable;
 
+// Building with -DASYNC_SCHEDULER=graph, queue, steal, priority or fair
+// binds that scheduler statically: SCHED_CALL becomes a direct call to
+// <kind>_<op> that LTO can inline, and RuntimeOptions.scheduler is ignored
+// with a warning. Otherwise calls go through the vtable picked by
+// async_init.
+#define __SCHED_NAME(kind, op) kind##_##op
+#define SCHED_FN(kind, op) __SCHED_NAME(kind, op)
+#ifdef ASYNC_SCHEDULER
+#define SCHED_CALL(s, op, ...) SCHED_FN(ASYNC_SCHEDULER, op)(__VA_ARGS__)
+extern const SchedulerKind SCHED_FN(ASYNC_SCHEDULER, scheduler_kind);
+RegisterTask SCHED_FN(ASYNC_SCHEDULER, register_task);
+FinishTask SCHED_FN(ASYNC_SCHEDULER, finish_task);
+FreeTask SCHED_FN(ASYNC_SCHEDULER, free_task);
+PollTask SCHED_FN(ASYNC_SCHEDULER, poll_task);
+WaitReady SCHED_FN(ASYNC_SCHEDULER, wait_ready);
+CurrentTask SCHED_FN(ASYNC_SCHEDULER, current_task);
+NextTask SCHED_FN(ASYNC_SCHEDULER, next_task);
+ParkTask SCHED_FN(ASYNC_SCHEDULER, park_task);
+WakeTask SCHED_FN(ASYNC_SCHEDULER, wake_task);
+SetPriority SCHED_FN(ASYNC_SCHEDULER, set_priority);
+Cleanup SCHED_FN(ASYNC_SCHEDULER, cleanup);
+#else
+#define SCHED_CALL(s, op, ...) (s)->vtable->op(__VA_ARGS__)
+#endif
+
 typedef struct {
   void *data;
   SchedulerVTable *vtable;
+  // Set by schedulers that run tasks on several threads. It is held while
+  // runtime state is touched and carried across async_switch: whoever
+  // switches away keeps it locked and the task that resumes unlocks it.
+  pthread_mutex_t *lock;
 } Scheduler;
 
+// Everything a thread needs to run tasks. Sharded runtimes get one per
+// thread, the work stealing workers all point at the same one.
+typedef struct {
+  Scheduler scheduler;
+  TaskPool pool;
+  Reactor reactor;
+  int shard;
+  void *native_stack_ptr; // thread stack to go back to when main returns
+  int exit_code;
+  TimerWheel timers;
+  Blocking *blocking; // NULL until async_spawn_blocking is used
+  int coop_budget; // RuntimeOptions.coop_budget, 0 if turned off
+  long preempt_us;  // RuntimeOptions.preempt_us, 0 if turned off
+  timer_t preempt_timer;
+} Runtime;
+
+Runtime *current_runtime();
+void set_current_runtime(Runtime *rt);
 Scheduler *global_scheduler();
 TaskPool *global_pool();
 
 void use_queue_scheduler();
 void use_graph_scheduler();
+void use_steal_scheduler(int threads);
+void use_priority_scheduler();
+void use_fair_scheduler();
 
-void async_init();
-Handle start_new_task(AsyncFunction *fn, void *data);
+void async_init(const RuntimeOptions *opts);
+Handle create_task(AsyncFunction *fn, void *data, size_t stack_size);
+Handle create_stackless_task(AsyncFunction *fn, void *data);
+// opts may be NULL for the defaults
+Handle start_new_task(AsyncFunction *fn, void *data, const CallOptions *opts);
 void free_task(Handle h);
+// Check that h is not stale, use task_at and hot_at for bare indices.
 Task *get_task(Handle h);
+TaskHot *get_hot(Handle h);
+Task *task_at(int idx);
+TaskHot *hot_at(int idx);
+RunLink *link_at(int idx);
+Handle task_handle(int idx);
 State poll_state(Handle h);
 void wait_ready(Handle h);
 void finish_current_task(Handle *finished_task, Handle *next_task);
 Handle current_task_handle();
 Handle next_task_handle();
+void park_current_task();
+void transfer_current_task(Handle to);
+Handle take_sole_waiter(Handle h);
+void wake_task(Handle h);
+void coop_refill();
+void coop_charge();
+int preempt_save();
+void preempt_restore(int region);
+void preempt_begin();
+void preempt_end();
+void set_task_priority(Handle h, int priority);
+int create_group(unsigned weight);
+void set_group_cap(int group, int percent);
+TaskGroup group_at(int group);
+Handle wait_runnable_task();
+int wait_tasks(Handle *handles, int len, int count);
+int wait_tasks_until(Handle *handles, int len, int count, uint64_t deadline);
+void wake_waiters(Handle h);
+void measure_stack(Handle h);
+bool run_queued(int idx);
+void run_queue_init(RunQueue *q);
+void run_queue_push_back(RunQueue *q, int idx);
+void run_queue_push_front(RunQueue *q, int idx);
+int run_queue_pop_front(RunQueue *q);
+void run_queue_rotate(RunQueue *q);
+void run_queue_remove(RunQueue *q, int idx);
 void async_deinit();
+void runtime_lock();
+void runtime_unlock();
+void runtime_release();
+void runtime_reacquire();
 
 #endif
@@ -0,0 +1,245 @@
+#include "stack.h"
+#include "storage.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define PAGE_SIZE 4096
+#define HUGE_PAGE_SIZE (2 << 20)
+
+static int size_class(size_t size) {
+  int c = 0;
+  while (((size_t)STACK_MIN_SIZE << c) < size)
+    c++;
+  assert(c < STACK_CLASSES && "stack size is too big");
+  return c;
+}
+
+static size_t class_size(int c) { return (size_t)STACK_MIN_SIZE << c; }
+
+void stack_pool_init(StackPool *p, size_t warm_limit, bool guard, bool huge) {
+  *p = (StackPool){0};
+  p->warm_limit = warm_limit;
+  // a guard page or MADV_DONTNEED would split the huge page it lands in
+  p->guard = guard && !huge;
+  p->huge = huge;
+}
+
+// Hands the last freed stack to the warm pool, or back to the kernel once the
+// pool is full.
+static void flush_deferred(StackPool *p) {
+  if (!p->deferred)
+    return;
+  int c = size_class(p->deferred_size);
+  if (p->huge || p->warm_size + p->deferred_size <= p->warm_limit) {
+    stack_push(&p->warm[c], p->deferred);
+    p->warm_size += p->deferred_size;
+  } else {
+    if (madvise(p->deferred, p->deferred_size, MADV_DONTNEED) == -1)
+      perror("madvise");
+    stack_push(&p->cold[c], p->deferred);
+  }
+  p->deferred = NULL;
+}
+
+static void *map_stack(size_t size) {
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                    -1, 0);
+  if (base == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  return base;
+}
+
+// MAP_HUGETLB only works with pages reserved in vm.nr_hugepages, and
+// without MAP_NORESERVE the mmap fails up front instead of the first touch
+// raising SIGBUS once they run out. Without reserved pages the slab is
+// aligned to a huge page by hand and left to transparent huge pages.
+// MAP_STACK is left out on purpose, recent kernels take it as a request for
+// small pages.
+static void *map_huge(size_t size) {
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (base != MAP_FAILED)
+    return base;
+
+  char *raw = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (raw == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  char *aligned = (char *)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) &
+                           ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+  if (aligned > raw)
+    munmap(raw, aligned - raw);
+  munmap(aligned + size, raw + HUGE_PAGE_SIZE - aligned);
+  if (madvise(aligned, size, MADV_HUGEPAGE) == -1)
+    perror("madvise");
+  return aligned;
+}
+
+// Every guard page splits the slab mapping, so with guards on each stack
+// costs two entries against vm.max_map_count.
+static void *carve(StackPool *p, int c) {
+  size_t slot = class_size(c) + (p->guard ? PAGE_SIZE : 0);
+  StackSlab *s = p->slabs[c];
+  if (!s || s->used + slot > s->size) {
+    size_t size = STACK_SLAB_SIZE;
+    if (size < slot * 4)
+      size = slot * 4;
+    void *base;
+    if (p->huge) {
+      size = (size + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+      base = map_huge(size);
+    } else {
+      base = map_stack(size);
+    }
+    s = malloc(sizeof(StackSlab));
+    assert(s);
+    *s = (StackSlab){.next = p->slabs[c], .base = base, .size = size};
+    p->slabs[c] = s;
+  }
+
+  char *stack = s->base + s->used;
+  s->used += slot;
+  if (p->guard) {
+    if (mprotect(stack, PAGE_SIZE, PROT_NONE) == -1) {
+      perror("mprotect");
+      exit(1);
+    }
+    stack += PAGE_SIZE;
+  }
+  return stack;
+}
+
+void *stack_alloc(StackPool *p, size_t *size) {
+  flush_deferred(p);
+  int c = size_class(*size);
+  *size = class_size(c);
+
+  void *stack = NULL;
+  if (p->warm[c].len) {
+    stack_pop(&p->warm[c], &stack);
+    p->warm_size -= *size;
+  } else if (p->cold[c].len) {
+    stack_pop(&p->cold[c], &stack);
+  } else {
+    stack = carve(p, c);
+  }
+  return stack;
+}
+
+void stack_free(StackPool *p, void *base, size_t size) {
+  assert(base);
+  flush_deferred(p);
+  p->deferred = base;
+  p->deferred_size = size;
+}
+
+void stack_pool_deinit(StackPool *p) {
+  for (int c = 0; c < STACK_CLASSES; c++) {
+    for (StackSlab *s = p->slabs[c]; s;) {
+      StackSlab *next = s->next;
+      if (munmap(s->base, s->size) == -1)
+        perror("munmap");
+      free(s);
+      s = next;
+    }
+    free(p->warm[c].elems);
+    free(p->cold[c].elems);
+  }
+  *p = (StackPool){0};
+}
+
+void shared_stack_init(SharedStack *s, size_t size) {
+  *s = (SharedStack){0};
+  s->size = (size + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+  s->base = map_stack(s->size);
+  s->copier_stack = map_stack(SHARED_STACK_COPIER_SIZE);
+}
+
+bool shared_stack_contains(SharedStack *s, const void *p) {
+  return s->base && (const char *)p >= s->base &&
+         (const char *)p < s->base + s->size;
+}
+
+void shared_stack_deinit(SharedStack *s) {
+  if (s->base) {
+    munmap(s->base, s->size);
+    munmap(s->copier_stack, SHARED_STACK_COPIER_SIZE);
+  }
+  *s = (SharedStack){0};
+}
+
+#define STACK_PAINT 0xa5a5a5a5a5a5a5a5ull
+
+void stack_paint(void *base, size_t size) {
+  uint64_t *w = base;
+  for (size_t i = 0; i < size / sizeof(*w); i++)
+    w[i] = STACK_PAINT;
+}
+
+// Stacks grow down, so the first word from the bottom that lost its paint is
+// as deep as the task ever went.
+size_t stack_used(const void *base, size_t size) {
+  const uint64_t *w = base;
+  size_t words = size / sizeof(*w);
+  size_t i = 0;
+  while (i < words && w[i] == STACK_PAINT)
+    i++;
+  return (words - i) * sizeof(*w);
+}
+
+static int fn_eql(void *ctx, const char *x, const char *y, int size) {
+  return x != y;
+}
+
+static uint64_t fn_hash(void *ctx, const char *x, int size) {
+  return (uint64_t)(uintptr_t)x >> 4;
+}
+
+void stack_profile_init(StackProfile *p, bool enabled, bool auto_size) {
+  *p = (StackProfile){0};
+  p->enabled = enabled || auto_size;
+  p->auto_size = auto_size;
+  p->fns.equality_fn = fn_eql;
+  p->fns.hash_fn = fn_hash;
+}
+
+void stack_profile_record(StackProfile *p, void *fn, size_t used) {
+  HashNode *n = hash_map_insert(&p->fns, (const char *)fn, sizeof(fn));
+  if (!n->val) {
+    n->val = calloc(1, sizeof(StackUse));
+    assert(n->val);
+  }
+  StackUse *u = (StackUse *)n->val;
+  if (used > u->peak)
+    u->peak = used;
+  u->tasks++;
+}
+
+size_t stack_profile_size(StackProfile *p, void *fn) {
+  if (!p->auto_size)
+    return 0;
+  HashNode *n = hash_map_find(&p->fns, (const char *)fn, sizeof(fn));
+  if (!n)
+    return 0;
+  StackUse *u = (StackUse *)n->val;
+  if (u->tasks < STACK_AUTO_WARMUP)
+    return 0;
+  return u->peak + u->peak / 2 + STACK_AUTO_SLACK;
+}
+
+static void free_use(HashNode *n) { free(n->val); }
+
+void stack_profile_deinit(StackProfile *p) {
+  if (p->fns.cap)
+    hash_map_deinit(&p->fns, free_use);
+  *p = (StackProfile){0};
+}
@@ -0,0 +1,117 @@
+#ifndef __STACK_H__
+#define __STACK_H__
+
+#include "hashmap.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Stacks come in power of two size classes from STACK_MIN_SIZE up.
+#ifndef STACK_MIN_SIZE
+#define STACK_MIN_SIZE 4096
+#endif
+
+#ifndef STACK_CLASSES
+#define STACK_CLASSES 9 // 4KB .. 1MB
+#endif
+
+// slabs stacks are carved out of
+#ifndef STACK_SLAB_SIZE
+#define STACK_SLAB_SIZE (2 << 20)
+#endif
+
+// bytes of freed stacks that stay resident for reuse, the rest is returned
+// to the kernel with MADV_DONTNEED
+#ifndef STACK_WARM_POOL
+#define STACK_WARM_POOL (4 << 20)
+#endif
+
+typedef struct StackSlab {
+  struct StackSlab *next;
+  char *base;
+  size_t size;
+  size_t used;
+} StackSlab;
+
+typedef struct {
+  void **elems;
+  int len;
+  int cap;
+} StackList;
+
+typedef struct {
+  StackSlab *slabs[STACK_CLASSES]; // current slab of every class first
+  StackList warm[STACK_CLASSES];   // freed stacks that still have their pages
+  StackList cold[STACK_CLASSES];   // freed stacks given back to the kernel
+  size_t warm_size;                // bytes held by warm stacks
+  size_t warm_limit;
+  bool guard;     // a PROT_NONE page below every stack
+  bool huge;      // slabs on 2MB pages, freed stacks always stay warm
+  void *deferred; // stack freed while it may still be running on
+  size_t deferred_size;
+} StackPool;
+
+// One stack every task runs on, copy-on-switch like libco's shared stacks.
+// Only the task whose frames are on it at the moment (the occupant) can run;
+// switching copies the used part of the occupant's stack out to the heap and
+// the next task's part back in. The copying happens on a small private
+// stack of its own, since it overwrites the frames of both tasks.
+typedef struct {
+  char *base; // NULL unless the mode is on
+  size_t size;
+  int occupant; // handle idx of the task that owns the frames on the stack
+  char *copier_stack;
+  void *copier_stack_ptr;
+  int save; // handle idx to copy out before switching to restore
+  int restore;
+} SharedStack;
+
+#ifndef SHARED_STACK_COPIER_SIZE
+#define SHARED_STACK_COPIER_SIZE 16384
+#endif
+
+void stack_pool_init(StackPool *p, size_t warm_limit, bool guard, bool huge);
+// Rounds size up to a size class and returns the lowest usable address.
+void *stack_alloc(StackPool *p, size_t *size);
+// The stack is only recycled on the next call into the pool, so a task can
+// free its own stack right before switching away.
+void stack_free(StackPool *p, void *base, size_t size);
+void stack_pool_deinit(StackPool *p);
+
+// finished tasks of a function measured before its stack size is trusted
+#ifndef STACK_AUTO_WARMUP
+#define STACK_AUTO_WARMUP 16
+#endif
+
+// extra room on top of the deepest use seen, added to half of it again
+#ifndef STACK_AUTO_SLACK
+#define STACK_AUTO_SLACK 2048
+#endif
+
+// High-water marks of task stacks per function. New stacks are painted with
+// a pattern and scanned for the deepest overwritten byte once the task is
+// done. With auto_size, functions that were measured often enough get a
+// stack of their peak plus a margin instead of STACK_SIZE.
+typedef struct {
+  bool enabled;
+  bool auto_size;
+  HashMap fns; // AsyncFunction * -> StackUse
+} StackProfile;
+
+typedef struct {
+  size_t peak;
+  long tasks;
+} StackUse;
+
+void stack_paint(void *base, size_t size);
+size_t stack_used(const void *base, size_t size);
+void stack_profile_init(StackProfile *p, bool enabled, bool auto_size);
+void stack_profile_record(StackProfile *p, void *fn, size_t used);
+// stack size to use for fn, 0 if it is not known yet
+size_t stack_profile_size(StackProfile *p, void *fn);
+void stack_profile_deinit(StackProfile *p);
+
+void shared_stack_init(SharedStack *s, size_t size);
+bool shared_stack_contains(SharedStack *s, const void *p);
+void shared_stack_deinit(SharedStack *s);
+
+#endif // !__STACK_H__
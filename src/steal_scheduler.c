@@ -0,0 +1,286 @@
+#include "dbg.h"
+#include "reactor.h"
+#include "scheduler.h"
+#include "switch.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Chase-Lev deque of task handles. Only the owning worker pushes at the
+// bottom, everybody takes from the top. The owner does not pop from the
+// bottom like the original algorithm: taking from the top keeps its own run
+// order round robin, which async_skip relies on.
+typedef struct DequeArray {
+  long size; // power of two
+  struct DequeArray *prev; // smaller array kept alive for late thieves
+  int elems[];
+} DequeArray;
+
+typedef struct {
+  long top;
+  long bottom;
+  DequeArray *array;
+} Deque;
+
+#define DEQUE_ABORT -1 // lost a race, the deque may still have tasks
+
+static DequeArray *deque_array(long size, DequeArray *prev) {
+  DequeArray *a = malloc(sizeof(DequeArray) + size * sizeof(int));
+  assert(a);
+  a->size = size;
+  a->prev = prev;
+  return a;
+}
+
+static void deque_init(Deque *d) {
+  d->top = 0;
+  d->bottom = 0;
+  d->array = deque_array(64, NULL);
+}
+
+static void deque_push(Deque *d, int x) {
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+  long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+  DequeArray *a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+  if (b - t > a->size - 1) {
+    DequeArray *bigger = deque_array(a->size * 2, a);
+    for (long i = t; i < b; i++)
+      bigger->elems[i & (bigger->size - 1)] = a->elems[i & (a->size - 1)];
+    __atomic_store_n(&d->array, bigger, __ATOMIC_RELEASE);
+    a = bigger;
+  }
+  __atomic_store_n(&a->elems[b & (a->size - 1)], x, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+}
+
+// Returns a handle idx, 0 if the deque is empty or DEQUE_ABORT.
+static int deque_steal(Deque *d) {
+  long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+  if (t >= b)
+    return 0;
+  DequeArray *a = __atomic_load_n(&d->array, __ATOMIC_ACQUIRE);
+  int x = __atomic_load_n(&a->elems[t & (a->size - 1)], __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false,
+                                   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    return DEQUE_ABORT;
+  return x;
+}
+
+typedef struct {
+  Deque deque;
+  Handle current;
+  Handle idle; // runs on this worker whenever its deque is empty
+  int id;
+  pthread_t thread;
+} Worker;
+
+typedef struct {
+  Worker *workers;
+  int len;
+  Runtime *runtime; // shared by all the workers
+  int sleeping;     // idle workers waiting on wakeup
+  bool polling; // some idle worker blocks in the reactor
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+} Steal;
+
+static Steal steal = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wakeup = PTHREAD_COND_INITIALIZER,
+};
+static _Thread_local Worker *self = NULL;
+
+// Tasks migrate between threads, so the worker must be looked up again after
+// every switch. Keeping the access out of line stops the compiler from
+// caching the thread local address across calls.
+static __attribute__((noipa)) Worker *current_worker() {
+  assert(self);
+  return self;
+}
+
+static void worker_idle(void *args);
+
+// Own deque first, then the others starting from the next worker.
+static Handle steal_task(Steal *st, Worker *w) {
+  for (int i = 0; i < st->len; i++) {
+    Worker *victim = &st->workers[(w->id + i) % st->len];
+    int idx = DEQUE_ABORT;
+    while (idx == DEQUE_ABORT)
+      idx = deque_steal(&victim->deque);
+    if (idx)
+      return task_handle(idx);
+  }
+  return (Handle){0};
+}
+
+static Handle take_next(Steal *st, Worker *w) {
+  int idx = DEQUE_ABORT;
+  while (idx == DEQUE_ABORT)
+    idx = deque_steal(&w->deque);
+  if (idx)
+    return task_handle(idx);
+  if (w->idle.idx == 0)
+    w->idle = create_task(worker_idle, w, 0);
+  return w->idle;
+}
+
+static void push_task(Steal *st, Worker *w, Handle h) {
+  deque_push(&w->deque, h.idx);
+  if (st->sleeping)
+    pthread_cond_signal(&st->wakeup);
+}
+
+// Scheduler loop of a worker, entered with the runtime lock held whenever a
+// task of this worker parks or finishes and there is nothing queued locally.
+// Stealing does not need the lock, but switching into the stolen task does:
+// the worker that queued it keeps the lock until the task is switched out.
+static void worker_idle(void *args) {
+  Worker *w = args;
+  Steal *st = &steal;
+  while (true) {
+    Handle h = steal_task(st, w);
+    runtime_lock();
+    if (h.idx == 0)
+      h = steal_task(st, w);
+    if (h.idx) {
+      w->current = h;
+      async_switch(w->idle, h);
+      w->current = w->idle;
+    } else if (!st->polling && reactor_pending()) {
+      st->polling = true;
+      reactor_poll(-1);
+      st->polling = false;
+    } else if (st->sleeping == st->len - 1 && !st->polling &&
+               !reactor_pending()) {
+      fprintf(stderr, "deadlock: no runnable or parked tasks left\n");
+      abort();
+    } else {
+      st->sleeping++;
+      pthread_cond_wait(&st->wakeup, &st->lock);
+      st->sleeping--;
+    }
+    runtime_unlock();
+  }
+}
+
+static void *worker_main(void *args) {
+  Worker *w = args;
+  self = w;
+  set_current_runtime(steal.runtime);
+  runtime_lock();
+  w->idle = create_task(worker_idle, w, 0);
+  w->current = w->idle;
+  async_switch((Handle){0}, w->idle);
+  assert(false);
+  return NULL;
+}
+
+void steal_register_task(void *data, Handle h) {
+  Steal *st = data;
+  Worker *w = current_worker();
+  if (w->current.idx == 0) {
+    // the main task, run_async_main switches to it right away
+    w->current = h;
+    return;
+  }
+  push_task(st, w, h);
+}
+
+void steal_finish_task(void *data, Handle *finished, Handle *next) {
+  Steal *st = data;
+  Worker *w = current_worker();
+  *finished = w->current;
+  if (next->idx == 0)
+    *next = take_next(st, w);
+  w->current = *next;
+}
+
+void steal_free_task(void *data, Handle h) {}
+
+State steal_poll_task(void *data, Handle h) { return get_hot(h)->state; }
+
+void steal_wait_ready(void *data, Handle h) {
+  if (get_hot(h)->state != READY)
+    wait_tasks(&h, 1, 1);
+}
+
+Handle steal_current_task(void *data) { return current_worker()->current; }
+
+Handle steal_next_task(void *data) {
+  Steal *st = data;
+  Worker *w = current_worker();
+  push_task(st, w, w->current);
+  // if a thief got the current task first, it resumes there once we switch
+  // to the idle loop and release the lock
+  w->current = take_next(st, w);
+  return w->current;
+}
+
+void steal_park_task(void *data, Handle *current, Handle *next) {
+  steal_finish_task(data, current, next);
+}
+
+void steal_wake_task(void *data, Handle h) {
+  Steal *st = data;
+  push_task(st, current_worker(), h);
+}
+
+void steal_set_priority(void *data, Handle h, int priority) {}
+
+// Other workers may still be stealing when the main task exits, so the
+// deques are left for the process exit to reclaim.
+void steal_cleanup(void *data) {}
+
+const SchedulerKind steal_scheduler_kind = SCHEDULER_STEAL;
+
+static SchedulerVTable vtable = {
+    .register_task = steal_register_task,
+    .finish_task = steal_finish_task,
+    .free_task = steal_free_task,
+    .poll_task = steal_poll_task,
+    .wait_ready = steal_wait_ready,
+    .current_task = steal_current_task,
+    .next_task = steal_next_task,
+    .park_task = steal_park_task,
+    .wake_task = steal_wake_task,
+    .set_priority = steal_set_priority,
+    .cleanup = steal_cleanup,
+};
+
+// The calling thread becomes worker 0, the rest get a thread of their own.
+void use_steal_scheduler(int threads) {
+  if (threads <= 0)
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads <= 0)
+    threads = 1;
+
+  Steal *st = &steal;
+  st->runtime = current_runtime();
+  st->len = threads;
+  st->workers = calloc(threads, sizeof(Worker));
+  assert(st->workers);
+  for (int i = 0; i < threads; i++) {
+    st->workers[i].id = i;
+    deque_init(&st->workers[i].deque);
+  }
+  self = &st->workers[0];
+
+  Scheduler *s = global_scheduler();
+  s->data = st;
+  s->vtable = &vtable;
+  s->lock = &st->lock;
+
+  for (int i = 1; i < threads; i++) {
+    if (pthread_create(&st->workers[i].thread, NULL, worker_main,
+                       &st->workers[i]) != 0) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+}
@@ -1,11 +1,16 @@
 #include "async.h"
 #include "dbg.h"
 #include "scheduler.h"
+#include "switch.h"
 #include <assert.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 
-void async_switch_asm(void **f1_stack_ptr, // rdi
+// Reads its arguments straight from the registers, so it must not be inlined
+// or have its signature changed by interprocedural passes (LTO does both).
+__attribute__((noipa)) void async_switch_asm(void **f1_stack_ptr, // rdi
                       void *f2_stack_ptr,  // rsi
                       long f2_first_start, // rdx
                       void *f2_fn,         // rcx
@@ -38,30 +43,121 @@ void async_switch_asm(void **f1_stack_ptr, // rdi
                "\n");
 }
 
-void async_switch(Handle from, Handle to) {
-  assert(to.idx != 0);
-  DBG("switch %d -> %d", from.idx, to.idx);
-  assert(from.idx != to.idx);
+// First frame of every task. The runtime lock is still held by whoever
+// switched here, so the entry point is read before letting it go.
+static void task_entry(void *arg) {
+  Task *t = task_at((int)(long)arg);
+  AsyncFunction *fn = t->fn;
+  void *data = t->data;
+  runtime_unlock();
+  fn(data);
+}
 
-  Task *f1 = (from.idx == 0 ? NULL : get_task(from));
-  Task *f2 = get_task(to);
+// Stackless tasks keep no frames between runs, so every thread runs all of
+// them on one stack and starts from its top each time. Switching away from
+// the host stack simply abandons whatever is on it.
+static _Thread_local char *stackless_host = NULL;
 
-  long f2_first_call = f2->state == INIT;
+static void enter_stackless(void **from_stack_ptr, Handle to) {
+  if (!stackless_host) {
+    size_t size = STACK_SIZE;
+    stackless_host = (char *)stack_alloc(&global_pool()->stacks, &size) + size;
+  }
+  async_switch_asm(from_stack_ptr, stackless_host, 1, stackless_entry,
+                   (void *)(long)to.idx);
+}
+
+void switch_deinit() { stackless_host = NULL; }
+
+static void jump(void **from_stack_ptr, Handle to) {
+  TaskHot *f2 = get_hot(to);
   assert(f2->state != FREE);
   assert(f2->state != READY);
+  // only stackless tasks have no stack pointer
+  if (!f2->stack_ptr) {
+    f2->state = RUNNING;
+    enter_stackless(from_stack_ptr, to);
+    return;
+  }
+
+  long f2_first_call = f2->state == INIT;
 
   if (f2_first_call) {
     DBG("%d starting for the first time", to.idx);
     f2->state = RUNNING;
   }
-  assert(f2->stack_ptr != NULL);
 
-  if (f1) {
-    async_switch_asm(&f1->stack_ptr, f2->stack_ptr, f2_first_call, f2->fn,
-                     f2->data);
+  async_switch_asm(from_stack_ptr, f2->stack_ptr, f2_first_call, task_entry,
+                   (void *)(long)to.idx);
+}
+
+// Runs on its own stack between two tasks sharing one: saves the used part
+// of the stack for the task that left, puts back the one of the task that
+// comes next and jumps into it.
+static void copier(void *arg) {
+  SharedStack *s = arg;
+  while (true) {
+    char *top = s->base + s->size;
+    if (s->save) {
+      Task *t = task_at(s->save);
+      void *sp = hot_at(s->save)->stack_ptr;
+      size_t len = top - (char *)sp;
+      if (len > t->saved_cap || len < t->saved_cap / 2) {
+        t->saved = realloc(t->saved, len);
+        assert(t->saved);
+        t->saved_cap = len;
+      }
+      memcpy(t->saved, sp, len);
+      t->saved_len = len;
+    }
+    Task *t = task_at(s->restore);
+    if (t->saved_len)
+      memcpy(top - t->saved_len, t->saved, t->saved_len);
+    s->occupant = s->restore;
+    jump(&s->copier_stack_ptr, task_handle(s->restore));
+  }
+}
+
+static void switch_to(int from, void **from_stack_ptr, Handle to) {
+  SharedStack *s = &global_pool()->shared;
+  if (!s->base || s->occupant == to.idx || !get_hot(to)->stack_ptr) {
+    jump(from_stack_ptr, to);
+    return;
+  }
+  // the frames on the stack only matter if they belong to whoever leaves
+  s->save = from && from == s->occupant ? from : 0;
+  s->restore = to.idx;
+  if (s->copier_stack_ptr) {
+    async_switch_asm(from_stack_ptr, s->copier_stack_ptr, 0, NULL, NULL);
   } else {
-    async_switch_asm(NULL, f2->stack_ptr, f2_first_call, f2->fn, f2->data);
+    async_switch_asm(from_stack_ptr, s->copier_stack + SHARED_STACK_COPIER_SIZE,
+                     1, copier, s);
   }
+}
+
+void async_switch(Handle from, Handle to) {
+  assert(to.idx != 0);
+  DBG("switch %d -> %d", from.idx, to.idx);
+  assert(from.idx != to.idx);
+  coop_refill();
+  int region = preempt_save();
+  void **from_stack_ptr = from.idx == 0 ? NULL : &get_hot(from)->stack_ptr;
+  // a stackless task starts over on the host stack every time, and has to
+  // keep its NULL stack_ptr for jump to tell it apart
+  if (from_stack_ptr && !*from_stack_ptr)
+    from_stack_ptr = NULL;
+  switch_to(from.idx, from_stack_ptr, to);
+  preempt_restore(region);
+}
+
+// Like async_switch from no task, but keeps the thread's own stack so that
+// async_switch_native can return to it once the runtime is done.
+void async_switch_from_native(void **native_stack_ptr, Handle to) {
+  assert(to.idx != 0);
+  coop_refill();
+  switch_to(0, native_stack_ptr, to);
+}
 
-  return;
+void async_switch_native(void *native_stack_ptr) {
+  async_switch_asm(NULL, native_stack_ptr, 0, NULL, NULL);
 }
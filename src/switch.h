@@ -4,5 +4,10 @@
 #include "async.h"
 
 void async_switch(Handle from, Handle to);
+void async_switch_from_native(void **native_stack_ptr, Handle to);
+void async_switch_native(void *native_stack_ptr);
+void switch_deinit();
+// first frame on the stackless host stack, runs the stackless task idx
+void stackless_entry(void *idx);
 
 #endif // !__SWITCH_H__
@@ -18,14 +18,7 @@ void async_sleep(void *data) {
     printf("%s: %ld seconds left\n", __func__, delay - (now - start));
     if (start + delay <= now)
       break;
-    async_skip();
-    struct timespec sleep_delay = {
-        .tv_sec = 0,
-        .tv_nsec = 100000000,
-    };
-    if (nanosleep(&sleep_delay, NULL) < 0) {
-      perror("nanosleep:");
-    }
+    async_sleep_ns(100000000);
   }
 
   async_return(data);
@@ -47,9 +40,7 @@ void async_sum(void *data) {
   char buf[256] = {0};
   for (int i = 0; i < n; i++) {
     pack(buf, sizeof(buf), "ii", sum, i);
-    Handle h = async_call(async_add2, buf);
-    unpack(await(h), "i", &sum);
-    async_free(h);
+    unpack(await_call(async_add2, buf), "i", &sum);
     printf("%s: %d/%d summed\n", __func__, i, n);
   }
   async_return((void *)(long)sum);
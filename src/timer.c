@@ -0,0 +1,173 @@
+#include "timer.h"
+#include "scheduler.h"
+#include <assert.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+
+// A hierarchical timing wheel (Varghese and Lauck): starting, stopping and
+// expiring a timer is O(1), and the wheel moves one tick at a time whenever
+// the reactor is polled. Level 0 holds the timers of the next TIMER_SLOTS
+// ticks; whenever its index wraps around, the next slot of level 1 is spread
+// over level 0, and so on up.
+
+#define SLOT_MASK (TIMER_SLOTS - 1)
+
+static TimerWheel *wheel() { return &current_runtime()->timers; }
+
+uint64_t timer_clock() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t timer_deadline(long timeout_ns) {
+  return timeout_ns < 0 ? 0 : timer_clock() + timeout_ns;
+}
+
+void timer_wheel_init(TimerWheel *w) {
+  memset(w, 0, sizeof(*w));
+  w->now = timer_clock() / TIMER_TICK_NS;
+}
+
+static void link_timer(TimerWheel *w, Timer *t) {
+  uint64_t delta = t->expires - w->now;
+  uint64_t at = t->expires;
+  int level = 0;
+  while (level < TIMER_LEVELS - 1 &&
+         delta >= (uint64_t)1 << (TIMER_SLOT_BITS * (level + 1)))
+    level++;
+  uint64_t span = (uint64_t)1 << (TIMER_SLOT_BITS * TIMER_LEVELS);
+  if (delta >= span)
+    at = w->now + span - 1;
+  int idx = (at >> (TIMER_SLOT_BITS * level)) & SLOT_MASK;
+  Timer **slot = &w->slots[level][idx];
+  t->next = *slot;
+  if (t->next)
+    t->next->pprev = &t->next;
+  t->pprev = slot;
+  *slot = t;
+}
+
+static void unlink_timer(Timer *t) {
+  *t->pprev = t->next;
+  if (t->next)
+    t->next->pprev = t->pprev;
+  t->pprev = NULL;
+}
+
+void timer_start(uint64_t deadline, TimerExpire *expire, long arg) {
+  TimerWheel *w = wheel();
+  Handle h = current_task_handle();
+  Timer *t = &task_at(h.idx)->timer;
+  assert(!t->pprev && "task already has a timer running");
+  // an empty wheel is not advanced, catch up before counting from now
+  if (w->len == 0)
+    w->now = timer_clock() / TIMER_TICK_NS;
+  t->expires = (deadline + TIMER_TICK_NS - 1) / TIMER_TICK_NS;
+  if (t->expires <= w->now)
+    t->expires = w->now + 1;
+  t->task = h;
+  t->expire = expire;
+  t->arg = arg;
+  t->fired = false;
+  link_timer(w, t);
+  w->len++;
+}
+
+bool timer_stop() {
+  Timer *t = &task_at(current_task_handle().idx)->timer;
+  if (t->pprev) {
+    unlink_timer(t);
+    wheel()->len--;
+  }
+  return t->fired;
+}
+
+static int fire(TimerWheel *w, Timer *list) {
+  int woken = 0;
+  while (list) {
+    Timer *t = list;
+    list = t->next;
+    t->pprev = NULL;
+    w->len--;
+    // whatever the task waited for may have woken it already
+    if (get_hot(t->task)->state != PARKED)
+      continue;
+    t->fired = true;
+    if (t->expire) {
+      t->expire(t->task, t->arg);
+    } else {
+      wake_task(t->task);
+    }
+    woken++;
+  }
+  return woken;
+}
+
+static int advance(TimerWheel *w, uint64_t to) {
+  int woken = 0;
+  while (w->now < to && w->len) {
+    w->now++;
+    // spread the slots that came around, the highest one first since its
+    // timers can land in the slots below
+    int top = 0;
+    while (top < TIMER_LEVELS - 1 &&
+           (w->now & (((uint64_t)1 << (TIMER_SLOT_BITS * (top + 1))) - 1)) == 0)
+      top++;
+    for (int level = top; level > 0; level--) {
+      Timer **slot =
+          &w->slots[level][(w->now >> (TIMER_SLOT_BITS * level)) & SLOT_MASK];
+      Timer *t = *slot;
+      *slot = NULL;
+      while (t) {
+        Timer *next = t->next;
+        link_timer(w, t);
+        t = next;
+      }
+    }
+    Timer **slot = &w->slots[0][w->now & SLOT_MASK];
+    Timer *list = *slot;
+    *slot = NULL;
+    woken += fire(w, list);
+  }
+  if (w->now < to)
+    w->now = to;
+  return woken;
+}
+
+int timers_expire() {
+  TimerWheel *w = wheel();
+  if (w->len == 0)
+    return 0;
+  return advance(w, timer_clock() / TIMER_TICK_NS);
+}
+
+int timers_pending() { return wheel()->len; }
+
+int timers_timeout_ms() {
+  TimerWheel *w = wheel();
+  if (w->len == 0)
+    return -1;
+  // the first slot with anything in it on every level, for the levels above
+  // 0 that is when it gets spread out, which is no later than its timers
+  uint64_t ticks = UINT64_MAX;
+  for (int level = 0; level < TIMER_LEVELS; level++) {
+    int shift = TIMER_SLOT_BITS * level;
+    uint64_t cur = w->now >> shift;
+    for (int k = 1; k <= TIMER_SLOTS; k++) {
+      if (w->slots[level][(cur + k) & SLOT_MASK]) {
+        uint64_t at = ((cur + k) << shift) - w->now;
+        if (at < ticks)
+          ticks = at;
+        break;
+      }
+    }
+  }
+  uint64_t due = (w->now + ticks) * TIMER_TICK_NS;
+  uint64_t now = timer_clock();
+  if (due <= now)
+    return 0;
+  uint64_t ms = (due - now + 999999) / 1000000;
+  return ms > INT_MAX ? INT_MAX : (int)ms;
+}
@@ -0,0 +1,57 @@
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include "async.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Resolution of the wheel, deadlines are rounded up to whole ticks.
+#ifndef TIMER_TICK_NS
+#define TIMER_TICK_NS 1000000
+#endif
+
+// Every level has TIMER_SLOTS slots, each one as wide as the whole level
+// below it. A timer further out than the top level reaches waits in the
+// farthest slot and is put back whenever that slot comes around.
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+#define TIMER_LEVELS 4
+
+// Called instead of waking the task when its timer runs out. It has to get
+// the task out of whatever it waits for and wake it, or make sure whatever
+// it waits for finishes soon.
+typedef void TimerExpire(Handle task, long arg);
+
+// Every task has one, it can only wait for one thing at a time.
+typedef struct Timer {
+  struct Timer *next, **pprev; // in its slot while running, pprev NULL if not
+  uint64_t expires;          // tick
+  Handle task;
+  TimerExpire *expire; // NULL just wakes the task
+  long arg;
+  bool fired;
+} Timer;
+
+typedef struct {
+  Timer *slots[TIMER_LEVELS][TIMER_SLOTS];
+  uint64_t now; // last tick expired
+  int len;      // running timers
+} TimerWheel;
+
+uint64_t timer_clock(); // CLOCK_MONOTONIC in ns
+// absolute deadline timeout_ns from now, 0 (no deadline) if it is negative
+uint64_t timer_deadline(long timeout_ns);
+
+void timer_wheel_init(TimerWheel *w);
+// Starts the current task's timer. The task should park right after and
+// call timer_stop once it is back, whatever woke it.
+void timer_start(uint64_t deadline, TimerExpire *expire, long arg);
+// Returns whether the current task's timer ran out.
+bool timer_stop();
+// Expires every timer up to the current time, returns how many there were.
+int timers_expire();
+int timers_pending();
+// ms until the earliest timer could run out, -1 if none is running
+int timers_timeout_ms();
+
+#endif // !__TIMER_H__
@@ -0,0 +1,671 @@
+#include "dbg.h"
+#include "reactor.h"
+#include "scheduler.h"
+#include "storage.h"
+#include <assert.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef URING_ENTRIES
+#define URING_ENTRIES 256
+#endif
+
+// amount of buffers in the provided buffer ring, must be a power of two
+#ifndef URING_BUF_COUNT
+#define URING_BUF_COUNT 1024
+#endif
+
+#ifndef URING_BUF_SIZE
+#define URING_BUF_SIZE 4096
+#endif
+
+#define URING_BGID 0
+#define SEQ_MASK 0xffffff
+
+// What a completion belongs to is packed into its user_data: the low byte is
+// the op, then 24 bits of sequence number and 32 bits of id. One-shot
+// requests are owned by a parked task (id is its handle, seq counts its
+// requests), multishot requests by an fd (id is the fd, seq its generation).
+// Completions with an outdated seq are dropped.
+typedef enum {
+  OP_IGNORE,
+  OP_TASK,
+  OP_ACCEPT,
+  OP_RECV,
+} UringOp;
+
+typedef struct {
+  uint16_t bid;
+  int len;
+  int off;
+} Chunk;
+
+typedef struct {
+  Chunk *elems;
+  int start, end, cap;
+} ChunkQueue;
+
+typedef struct {
+  int *elems;
+  int start, end, cap;
+} FdQueue;
+
+typedef struct {
+  uint32_t gen;
+  Handle reader; // task waiting for data or for a connection
+  bool recv_armed;
+  bool accept_armed;
+  bool starved; // multishot recv ran out of provided buffers
+  bool eof;
+  int error;
+  ChunkQueue chunks;
+  FdQueue accepted; // accepted fds, or -errno
+} UringFd;
+
+typedef struct {
+  uint32_t seq;
+  int res;
+} UringTask;
+
+typedef struct {
+  int ring_fd;
+
+  unsigned *sq_head, *sq_tail, *sq_flags;
+  unsigned sq_mask, sq_entries;
+  unsigned sq_local_tail; // includes SQEs that are not published yet
+  unsigned sq_submitted;
+  struct io_uring_sqe *sqes;
+
+  unsigned *cq_head, *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+
+  void *ring;
+  size_t ring_size;
+  size_t sqes_size;
+
+  struct io_uring_buf_ring *buf_ring;
+  char *bufs;
+  uint16_t buf_tail;
+
+  UringFd *fds;
+  int fds_cap;
+  UringTask *tasks;
+  int tasks_cap;
+  int waiters;
+} Uring;
+
+static uint64_t pack_user_data(UringOp op, uint32_t id, uint32_t seq) {
+  return (uint64_t)id << 32 | (uint64_t)(seq & SEQ_MASK) << 8 | op;
+}
+
+static UringFd *uring_fd(Uring *u, int fd) {
+  assert(fd >= 0);
+  if (fd >= u->fds_cap) {
+    int new_cap = u->fds_cap * 2 + 10;
+    if (new_cap <= fd)
+      new_cap = fd + 1;
+    u->fds = realloc(u->fds, new_cap * sizeof(UringFd));
+    assert(u->fds);
+    memset(u->fds + u->fds_cap, 0, (new_cap - u->fds_cap) * sizeof(UringFd));
+    u->fds_cap = new_cap;
+  }
+  return &u->fds[fd];
+}
+
+static UringTask *uring_task(Uring *u, int idx) {
+  assert(idx > 0);
+  if (idx >= u->tasks_cap) {
+    int new_cap = u->tasks_cap * 2 + 10;
+    if (new_cap <= idx)
+      new_cap = idx + 1;
+    u->tasks = realloc(u->tasks, new_cap * sizeof(UringTask));
+    assert(u->tasks);
+    memset(u->tasks + u->tasks_cap, 0,
+           (new_cap - u->tasks_cap) * sizeof(UringTask));
+    u->tasks_cap = new_cap;
+  }
+  return &u->tasks[idx];
+}
+
+static void recycle_buffer(Uring *u, uint16_t bid) {
+  struct io_uring_buf *b =
+      &u->buf_ring->bufs[u->buf_tail & (URING_BUF_COUNT - 1)];
+  b->addr = (uint64_t)(u->bufs + (size_t)bid * URING_BUF_SIZE);
+  b->len = URING_BUF_SIZE;
+  b->bid = bid;
+  u->buf_tail++;
+  __atomic_store_n(&u->buf_ring->tail, u->buf_tail, __ATOMIC_RELEASE);
+}
+
+// Publishes queued SQEs and, if min_complete is set, waits for completions.
+static void enter(Uring *u, unsigned min_complete, int timeout_ms) {
+  __atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+  unsigned to_submit = u->sq_local_tail - u->sq_submitted;
+  // with COOP_TASKRUN completions are only posted once we enter the kernel
+  bool task_work = __atomic_load_n(u->sq_flags, __ATOMIC_RELAXED) &
+                   IORING_SQ_TASKRUN;
+  if (to_submit == 0 && min_complete == 0 && !task_work)
+    return;
+
+  unsigned flags = IORING_ENTER_GETEVENTS;
+  struct __kernel_timespec ts = {0};
+  struct io_uring_getevents_arg arg = {0};
+  void *argp = NULL;
+  size_t argsz = 0;
+  if (min_complete) {
+    if (timeout_ms >= 0) {
+      ts.tv_sec = timeout_ms / 1000;
+      ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+      arg.ts = (uint64_t)&ts;
+      flags |= IORING_ENTER_EXT_ARG;
+      argp = &arg;
+      argsz = sizeof(arg);
+    }
+  }
+
+  int ret = syscall(__NR_io_uring_enter, u->ring_fd, to_submit, min_complete,
+                    flags, argp, argsz);
+  if (ret == -1) {
+    if (errno == EINTR || errno == ETIME || errno == EAGAIN || errno == EBUSY)
+      return;
+    perror("io_uring_enter");
+    exit(1);
+  }
+  u->sq_submitted += ret;
+}
+
+static struct io_uring_sqe *get_sqe(Uring *u) {
+  unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+  if (u->sq_local_tail - head == u->sq_entries) {
+    enter(u, 0, 0);
+    head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    assert(u->sq_local_tail - head < u->sq_entries);
+  }
+  struct io_uring_sqe *sqe = &u->sqes[u->sq_local_tail & u->sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  u->sq_local_tail++;
+  return sqe;
+}
+
+// The kernel may still be using the buffers of the request, so the task
+// keeps waiting for its completion, which cancelling makes come early.
+static void request_timed_out(Handle task, long arg) {
+  Uring *u = global_reactor()->data;
+  struct io_uring_sqe *sqe = get_sqe(u);
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->addr = pack_user_data(OP_TASK, task.idx, uring_task(u, task.idx)->seq);
+  sqe->user_data = pack_user_data(OP_IGNORE, 0, 0);
+}
+
+// Parks the current task until the completion for sqe arrives and returns
+// its result, -ETIMEDOUT if deadline cancelled it. The SQE itself goes out
+// with the next poll of the reactor.
+static int submit_and_wait(Uring *u, struct io_uring_sqe *sqe,
+                           uint64_t deadline) {
+  Handle h = current_task_handle();
+  UringTask *t = uring_task(u, h.idx);
+  sqe->user_data = pack_user_data(OP_TASK, h.idx, t->seq);
+  u->waiters++;
+  if (deadline)
+    timer_start(deadline, request_timed_out, 0);
+  park_current_task();
+  bool expired = deadline && timer_stop();
+  t = uring_task(u, h.idx);
+  return expired && t->res == -ECANCELED ? -ETIMEDOUT : t->res;
+}
+
+// off is only used by reads and writes of files, flags only by sockets.
+static int one_shot(Uring *u, uint8_t opcode, int fd, char *buf, int n,
+                    uint64_t off, int flags, uint64_t deadline) {
+  bool into_buf = opcode == IORING_OP_RECV || opcode == IORING_OP_READ;
+  // The kernel touches buf after we switched away. On a shared stack that
+  // memory belongs to another task by then, so go through the heap.
+  char *bounce = NULL;
+  if (shared_stack_contains(&global_pool()->shared, buf)) {
+    bounce = malloc(n);
+    assert(bounce);
+    if (!into_buf)
+      memcpy(bounce, buf, n);
+  }
+  struct io_uring_sqe *sqe = get_sqe(u);
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(bounce ? bounce : buf);
+  sqe->len = n;
+  sqe->off = off;
+  sqe->msg_flags = flags;
+  int res = submit_and_wait(u, sqe, deadline);
+  if (bounce) {
+    if (into_buf && res > 0)
+      memcpy(buf, bounce, res);
+    free(bounce);
+  }
+  if (res < 0) {
+    errno = -res;
+    return -1;
+  }
+  return res;
+}
+
+static void arm_recv(Uring *u, int fd, UringFd *f) {
+  struct io_uring_sqe *sqe = get_sqe(u);
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_BGID;
+  sqe->user_data = pack_user_data(OP_RECV, fd, f->gen);
+  f->recv_armed = true;
+}
+
+static void arm_accept(Uring *u, int fd, UringFd *f) {
+  struct io_uring_sqe *sqe = get_sqe(u);
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = fd;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->user_data = pack_user_data(OP_ACCEPT, fd, f->gen);
+  f->accept_armed = true;
+}
+
+// arg is the fd, its multishot request stays armed
+static void reader_timed_out(Handle task, long arg) {
+  Uring *u = global_reactor()->data;
+  u->fds[arg].reader = (Handle){0};
+  u->waiters--;
+  wake_task(task);
+}
+
+// Returns false if deadline passed before anything arrived.
+static bool park_reader(Uring *u, int fd, UringFd *f, uint64_t deadline) {
+  assert(f->reader.idx == 0 && "fd already has a reader");
+  f->reader = current_task_handle();
+  u->waiters++;
+  if (deadline)
+    timer_start(deadline, reader_timed_out, fd);
+  park_current_task();
+  return !deadline || !timer_stop();
+}
+
+static int timed_out() {
+  errno = ETIMEDOUT;
+  return -1;
+}
+
+static int wake_reader(Uring *u, UringFd *f) {
+  if (f->reader.idx == 0)
+    return 0;
+  wake_task(f->reader);
+  f->reader = (Handle){0};
+  u->waiters--;
+  return 1;
+}
+
+bool uring_wait_fd(void *data, int fd, uint32_t events, uint64_t deadline) {
+  Uring *u = data;
+  struct io_uring_sqe *sqe = get_sqe(u);
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = events;
+  return submit_and_wait(u, sqe, deadline) != -ETIMEDOUT;
+}
+
+int uring_recv(void *data, int fd, char *buf, int n, int flags,
+               uint64_t deadline) {
+  Uring *u = data;
+  if ((flags & ~MSG_NOSIGNAL) != 0)
+    return one_shot(u, IORING_OP_RECV, fd, buf, n, 0, flags, deadline);
+
+  while (true) {
+    UringFd *f = uring_fd(u, fd);
+    if (f->chunks.start != f->chunks.end) {
+      int copied = 0;
+      while (copied < n && f->chunks.start != f->chunks.end) {
+        Chunk *c = &f->chunks.elems[f->chunks.start];
+        int amt = c->len - c->off;
+        if (amt > n - copied)
+          amt = n - copied;
+        memcpy(buf + copied, u->bufs + (size_t)c->bid * URING_BUF_SIZE + c->off,
+               amt);
+        c->off += amt;
+        copied += amt;
+        if (c->off == c->len) {
+          Chunk done = {0};
+          queue_pop_front(&f->chunks, &done);
+          recycle_buffer(u, done.bid);
+        }
+      }
+      return copied;
+    }
+    if (f->error) {
+      errno = f->error;
+      f->error = 0;
+      return -1;
+    }
+    if (f->eof) {
+      f->eof = false;
+      return 0;
+    }
+    if (f->starved) {
+      // other connections hold every buffer, read straight into ours
+      f->starved = false;
+      return one_shot(u, IORING_OP_RECV, fd, buf, n, 0, flags, deadline);
+    }
+    if (!f->recv_armed)
+      arm_recv(u, fd, f);
+    if (!park_reader(u, fd, f, deadline))
+      return timed_out();
+  }
+}
+
+int uring_send(void *data, int fd, char *buf, int n, int flags,
+               uint64_t deadline) {
+  Uring *u = data;
+  return one_shot(u, IORING_OP_SEND, fd, buf, n, 0, flags, deadline);
+}
+
+int uring_accept(void *data, int fd, struct sockaddr *addr,
+                 socklen_t *addr_len, uint64_t deadline) {
+  Uring *u = data;
+  while (true) {
+    UringFd *f = uring_fd(u, fd);
+    if (f->accepted.start != f->accepted.end) {
+      int res = -1;
+      queue_pop_front(&f->accepted, &res);
+      if (res < 0) {
+        errno = -res;
+        return -1;
+      }
+      // multishot accept has nowhere to put the address
+      if (addr && getpeername(res, addr, addr_len) == -1) {
+        *addr_len = 0;
+      }
+      return res;
+    }
+    if (!f->accept_armed)
+      arm_accept(u, fd, f);
+    if (!park_reader(u, fd, f, deadline))
+      return timed_out();
+  }
+}
+
+// results are ints, so larger requests come back short
+static int clamp(size_t n) { return n > 1 << 30 ? 1 << 30 : n; }
+
+ssize_t uring_pread(void *data, int fd, void *buf, size_t n, off_t off) {
+  Uring *u = data;
+  return one_shot(u, IORING_OP_READ, fd, buf, clamp(n), off, 0, 0);
+}
+
+ssize_t uring_pwrite(void *data, int fd, const void *buf, size_t n,
+                     off_t off) {
+  Uring *u = data;
+  return one_shot(u, IORING_OP_WRITE, fd, (char *)buf, clamp(n), off, 0, 0);
+}
+
+int uring_fsync(void *data, int fd) {
+  Uring *u = data;
+  struct io_uring_sqe *sqe = get_sqe(u);
+  sqe->opcode = IORING_OP_FSYNC;
+  sqe->fd = fd;
+  int res = submit_and_wait(u, sqe, 0);
+  if (res < 0) {
+    errno = -res;
+    return -1;
+  }
+  return 0;
+}
+
+int uring_close(void *data, int fd) {
+  Uring *u = data;
+  if (fd >= 0 && fd < u->fds_cap) {
+    UringFd *f = &u->fds[fd];
+    assert(!f->reader.idx && "closing fd with waiters");
+    if (f->recv_armed || f->accept_armed) {
+      // multishot requests hold a reference to the file, and the fd has to
+      // be looked up before we close it, so this can't wait for the next tick
+      struct io_uring_sqe *sqe = get_sqe(u);
+      sqe->opcode = IORING_OP_ASYNC_CANCEL;
+      sqe->fd = fd;
+      sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+      sqe->user_data = pack_user_data(OP_IGNORE, 0, 0);
+      enter(u, 0, 0);
+    }
+    while (f->chunks.start != f->chunks.end) {
+      Chunk c = {0};
+      queue_pop_front(&f->chunks, &c);
+      recycle_buffer(u, c.bid);
+    }
+    while (f->accepted.start != f->accepted.end) {
+      int client = -1;
+      queue_pop_front(&f->accepted, &client);
+      if (client >= 0)
+        close(client);
+    }
+    f->gen++;
+    f->recv_armed = false;
+    f->accept_armed = false;
+    f->starved = false;
+    f->eof = false;
+    f->error = 0;
+  }
+  return close(fd);
+}
+
+static int handle_cqe(Uring *u, struct io_uring_cqe *cqe) {
+  UringOp op = cqe->user_data & 0xff;
+  uint32_t seq = (cqe->user_data >> 8) & SEQ_MASK;
+  uint32_t id = cqe->user_data >> 32;
+  bool more = cqe->flags & IORING_CQE_F_MORE;
+  int res = cqe->res;
+
+  switch (op) {
+  case OP_IGNORE: {
+    if (cqe->flags & IORING_CQE_F_BUFFER)
+      recycle_buffer(u, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+  } break;
+
+  case OP_TASK: {
+    UringTask *t = uring_task(u, id);
+    if ((t->seq & SEQ_MASK) != seq)
+      return 0;
+    t->seq++;
+    t->res = res;
+    wake_task(task_handle(id));
+    u->waiters--;
+    return 1;
+  } break;
+
+  case OP_RECV: {
+    UringFd *f = id < u->fds_cap ? &u->fds[id] : NULL;
+    if (!f || (f->gen & SEQ_MASK) != seq) {
+      if (cqe->flags & IORING_CQE_F_BUFFER)
+        recycle_buffer(u, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+      return 0;
+    }
+    if (res > 0) {
+      assert(cqe->flags & IORING_CQE_F_BUFFER);
+      Chunk c = {.bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT, .len = res};
+      queue_push_back(&f->chunks, c);
+    } else if (res == 0) {
+      f->eof = true;
+    } else if (res == -ENOBUFS) {
+      f->starved = true;
+    } else {
+      f->error = -res;
+    }
+    if (!more)
+      f->recv_armed = false;
+    return wake_reader(u, f);
+  } break;
+
+  case OP_ACCEPT: {
+    UringFd *f = id < u->fds_cap ? &u->fds[id] : NULL;
+    if (!f || (f->gen & SEQ_MASK) != seq) {
+      if (res >= 0)
+        close(res);
+      return 0;
+    }
+    queue_push_back(&f->accepted, res);
+    if (!more)
+      f->accept_armed = false;
+    return wake_reader(u, f);
+  } break;
+  }
+  return 0;
+}
+
+static int reap(Uring *u) {
+  int woken = 0;
+  unsigned head = *u->cq_head;
+  unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; head++) {
+    woken += handle_cqe(u, &u->cqes[head & u->cq_mask]);
+  }
+  __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+  return woken;
+}
+
+int uring_poll(void *data, int timeout_ms) {
+  Uring *u = data;
+  bool have_cqes = *u->cq_head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+  enter(u, (timeout_ms == 0 || have_cqes) ? 0 : 1, timeout_ms);
+  return reap(u);
+}
+
+int uring_pending(void *data) {
+  Uring *u = data;
+  return u->waiters;
+}
+
+void uring_cleanup(void *data) {
+  Uring *u = data;
+  if (u->ring_fd != -1)
+    close(u->ring_fd);
+  if (u->ring)
+    munmap(u->ring, u->ring_size);
+  if (u->sqes)
+    munmap(u->sqes, u->sqes_size);
+  if (u->buf_ring)
+    munmap(u->buf_ring, URING_BUF_COUNT * sizeof(struct io_uring_buf));
+  if (u->bufs)
+    munmap(u->bufs, (size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+  for (int i = 0; i < u->fds_cap; i++) {
+    free(u->fds[i].chunks.elems);
+    free(u->fds[i].accepted.elems);
+  }
+  free(u->fds);
+  free(u->tasks);
+  free(u);
+}
+
+static bool uring_setup(Uring *u) {
+  struct io_uring_params p = {0};
+  p.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+            IORING_SETUP_TASKRUN_FLAG;
+  int fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+  if (fd == -1 && errno == EINVAL) {
+    p = (struct io_uring_params){0};
+    fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+  }
+  if (fd == -1)
+    return false;
+  u->ring_fd = fd;
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP) ||
+      !(p.features & IORING_FEAT_EXT_ARG))
+    return false;
+
+  size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  u->ring_size = sq_size > cq_size ? sq_size : cq_size;
+  void *ring = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (ring == MAP_FAILED)
+    return false;
+  u->ring = ring;
+  u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  void *sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED)
+    return false;
+  u->sqes = sqes;
+
+  u->sq_head = ring + p.sq_off.head;
+  u->sq_tail = ring + p.sq_off.tail;
+  u->sq_flags = ring + p.sq_off.flags;
+  u->sq_mask = *(unsigned *)(ring + p.sq_off.ring_mask);
+  u->sq_entries = *(unsigned *)(ring + p.sq_off.ring_entries);
+  unsigned *sq_array = ring + p.sq_off.array;
+  for (unsigned i = 0; i < u->sq_entries; i++)
+    sq_array[i] = i;
+  u->sq_local_tail = *u->sq_tail;
+  u->sq_submitted = u->sq_local_tail;
+
+  u->cq_head = ring + p.cq_off.head;
+  u->cq_tail = ring + p.cq_off.tail;
+  u->cq_mask = *(unsigned *)(ring + p.cq_off.ring_mask);
+  u->cqes = ring + p.cq_off.cqes;
+
+  void *buf_ring = mmap(NULL, URING_BUF_COUNT * sizeof(struct io_uring_buf),
+                        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1, 0);
+  if (buf_ring == MAP_FAILED)
+    return false;
+  u->buf_ring = buf_ring;
+  void *bufs = mmap(NULL, (size_t)URING_BUF_COUNT * URING_BUF_SIZE,
+                    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (bufs == MAP_FAILED)
+    return false;
+  u->bufs = bufs;
+
+  struct io_uring_buf_reg reg = {
+      .ring_addr = (uint64_t)u->buf_ring,
+      .ring_entries = URING_BUF_COUNT,
+      .bgid = URING_BGID,
+  };
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg,
+              1) == -1)
+    return false;
+  for (int i = 0; i < URING_BUF_COUNT; i++)
+    recycle_buffer(u, i);
+
+  return true;
+}
+
+static ReactorVTable vtable = {
+    .wait_fd = uring_wait_fd,
+    .recv = uring_recv,
+    .send = uring_send,
+    .accept = uring_accept,
+    .pread = uring_pread,
+    .pwrite = uring_pwrite,
+    .fsync = uring_fsync,
+    .close = uring_close,
+    .poll = uring_poll,
+    .pending = uring_pending,
+    .cleanup = uring_cleanup,
+};
+
+bool use_uring_reactor() {
+  Uring *u = calloc(1, sizeof(Uring));
+  assert(u);
+  u->ring_fd = -1;
+  if (!uring_setup(u)) {
+    uring_cleanup(u);
+    return false;
+  }
+  Reactor *r = global_reactor();
+  r->data = u;
+  r->vtable = &vtable;
+  return true;
+}
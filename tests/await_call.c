@@ -0,0 +1,86 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address
+$$ -o ./build/tests/await_call ./tests/await_call.c -I src -L build -lasync
+!! ./build/tests/await_call
+
+%%
+## add: 1000 calls, sum 499500
+## nested: 10 levels, 55
+## blocking: 3 skips, bystander ran 3 times
+## awaits a task: 42
+##
+-------
+ */
+
+#include "../src/async.h"
+#include <stddef.h>
+#include <stdio.h>
+
+static int bystander_runs = 0;
+static volatile int stop = 0;
+
+void add(void *args) {
+  long *pair = args;
+  async_return((void *)(pair[0] + pair[1]));
+}
+
+void nested(void *args) {
+  long n = (long)args;
+  if (n == 0)
+    async_return(NULL);
+  long below = (long)await_call(nested, (void *)(n - 1));
+  async_return((void *)(below + n));
+}
+
+void bystander(void *args) {
+  while (!stop) {
+    bystander_runs++;
+    async_skip();
+  }
+  async_return(NULL);
+}
+
+void blocking(void *args) {
+  for (int i = 0; i < 3; i++)
+    async_skip();
+  async_return((void *)3);
+}
+
+void answer(void *args) {
+  async_skip();
+  async_return((void *)42);
+}
+
+void awaiter(void *args) {
+  Handle h = async_call(answer, NULL);
+  void *res = await(h);
+  async_free(h);
+  async_return(res);
+}
+
+void async_main(void *args) {
+  long sum = 0;
+  for (long i = 0; i < 1000; i++) {
+    long pair[2] = {sum, i};
+    sum = (long)await_call(add, pair);
+  }
+  printf("add: 1000 calls, sum %ld\n", sum);
+
+  printf("nested: 10 levels, %ld\n", (long)await_call(nested, (void *)10));
+
+  Handle by = async_call(bystander, NULL);
+  long skips = (long)await_call(blocking, NULL);
+  stop = 1;
+  await(by);
+  printf("blocking: %ld skips, bystander ran %d times\n", skips,
+         bystander_runs);
+
+  printf("awaits a task: %ld\n", (long)await_call(awaiter, NULL));
+
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  run_async_main(async_main, NULL);
+  return 0;
+}
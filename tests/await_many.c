@@ -0,0 +1,81 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address
+$$ -o ./build/tests/await_many ./tests/await_many.c -I src -L build -lasync
+!! ./build/tests/await_many
+
+%%
+## await_any: 1 finished first with 10
+## await_all: sum 999000
+## watcher 0: 42
+## watcher 1: 42
+##
+-------
+ */
+
+#include "../src/async.h"
+#include <stddef.h>
+#include <stdio.h>
+
+void skipper(void *args) {
+  long n = (long)args;
+  for (int i = 0; i < n; i++)
+    async_skip();
+  async_return((void *)(n * 10));
+}
+
+void doubler(void *args) {
+  long n = (long)args;
+  if (n % 3 == 0)
+    async_skip();
+  async_return((void *)(n * 2));
+}
+
+void answer(void *args) {
+  for (int i = 0; i < 5; i++)
+    async_skip();
+  async_return((void *)42);
+}
+
+void watcher(void *args) {
+  Handle h = *(Handle *)args;
+  async_return(await(h));
+}
+
+void async_main(void *args) {
+  Handle any[3] = {
+      async_call(skipper, (void *)5),
+      async_call(skipper, (void *)1),
+      async_call(skipper, (void *)3),
+  };
+  int idx = -1;
+  long res = (long)await_any(any, 3, &idx);
+  printf("await_any: %d finished first with %ld\n", idx, res);
+  await_all(any, 3, NULL);
+
+  static Handle all[1000];
+  static void *results[1000];
+  for (long i = 0; i < 1000; i++)
+    all[i] = async_call(doubler, (void *)i);
+  await_all(all, 1000, results);
+  long sum = 0;
+  for (int i = 0; i < 1000; i++)
+    sum += (long)results[i];
+  printf("await_all: sum %ld\n", sum);
+
+  Handle h = async_call(answer, NULL);
+  Handle watchers[2] = {
+      async_call(watcher, &h),
+      async_call(watcher, &h),
+  };
+  void *watched[2] = {0};
+  await_all(watchers, 2, watched);
+  for (int i = 0; i < 2; i++)
+    printf("watcher %d: %ld\n", i, (long)watched[i]);
+
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  run_async_main(async_main, NULL);
+  return 0;
+}
@@ -0,0 +1,113 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address -pthread
+$$ -o ./build/tests/blocking ./tests/blocking.c -I src -L build -lasync
+!! ./build/tests/blocking
+
+%% graph epoll
+## results: 0 2 4 6 8 10 12 14
+## ran side by side: yes
+## ticker ran meanwhile: yes
+## 40 calls done, at most 16 at a time: yes
+##
+-------
+
+%% queue uring
+## results: 0 2 4 6 8 10 12 14
+## ran side by side: yes
+## ticker ran meanwhile: yes
+## 40 calls done, at most 16 at a time: yes
+##
+-------
+
+%% steal epoll
+## results: 0 2 4 6 8 10 12 14
+## ran side by side: yes
+## ticker ran meanwhile: yes
+## 40 calls done, at most 16 at a time: yes
+##
+-------
+ */
+
+#include "../src/async.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static volatile int done = 0;
+static long ticks = 0;
+static int running = 0;
+static int most = 0;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void *slow_double(void *args) {
+  usleep(50000);
+  return (void *)((long)args * 2);
+}
+
+void *counted(void *args) {
+  int n = __atomic_add_fetch(&running, 1, __ATOMIC_RELAXED);
+  int seen = __atomic_load_n(&most, __ATOMIC_RELAXED);
+  while (n > seen &&
+         !__atomic_compare_exchange_n(&most, &seen, n, false, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED))
+    ;
+  usleep(10000);
+  __atomic_sub_fetch(&running, 1, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+void ticker(void *args) {
+  while (!done) {
+    async_sleep_ns(1000000);
+    __atomic_add_fetch(&ticks, 1, __ATOMIC_RELAXED);
+  }
+  async_return(NULL);
+}
+
+void async_main(void *args) {
+  Handle t = async_call(ticker, NULL);
+  double start = now();
+  Handle hs[8];
+  for (long i = 0; i < 8; i++)
+    hs[i] = async_spawn_blocking(slow_double, (void *)i);
+  void *results[8];
+  await_all(hs, 8, results);
+  double elapsed = now() - start;
+  done = 1;
+  await(t);
+  printf("results:");
+  for (int i = 0; i < 8; i++)
+    printf(" %ld", (long)results[i]);
+  printf("\n");
+  printf("ran side by side: %s\n", elapsed < 0.2 ? "yes" : "no");
+  printf("ticker ran meanwhile: %s\n", ticks >= 10 ? "yes" : "no");
+
+  static Handle many[40];
+  for (int i = 0; i < 40; i++)
+    many[i] = async_spawn_blocking(counted, NULL);
+  await_all(many, 40, NULL);
+  printf("40 calls done, at most %d at a time: %s\n", ASYNC_BLOCKING_THREADS,
+         most <= ASYNC_BLOCKING_THREADS ? "yes" : "no");
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  char kind[16] = {0}, io[16] = {0};
+  if (scanf("%15s %15s", kind, io) != 2)
+    return 1;
+  RuntimeOptions opts = {0};
+  if (strcmp(kind, "queue") == 0)
+    opts.scheduler = SCHEDULER_QUEUE;
+  if (strcmp(kind, "steal") == 0)
+    opts = (RuntimeOptions){.scheduler = SCHEDULER_STEAL, .threads = 2};
+  if (strcmp(io, "uring") == 0)
+    opts.io_backend = IO_URING;
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}
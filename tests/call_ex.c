@@ -0,0 +1,63 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address
+$$ -o ./build/tests/call_ex ./tests/call_ex.c -I src -L build -lasync
+!! ./build/tests/call_ex
+
+%%
+## deep: 2000 levels, sum 2001000
+## tiny: 100 tasks, sum 4950
+## deep again: 2000 levels, sum 2001000
+##
+-------
+ */
+
+#include "../src/async.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// roughly 200 bytes of stack per level, far more than STACK_SIZE in total
+long recurse(long n) {
+  volatile char pad[128];
+  memset((char *)pad, (int)n, sizeof(pad));
+  if (n == 0)
+    return pad[0];
+  return n + recurse(n - 1) + pad[0] - (char)n;
+}
+
+void deep(void *args) {
+  long n = (long)args;
+  async_return((void *)recurse(n));
+}
+
+void tiny(void *args) { async_return(args); }
+
+void async_main(void *args) {
+  CallOptions big = {.stack_size = 1 << 20};
+  CallOptions small = {.stack_size = 4096};
+
+  long sum = (long)await(async_call_ex(deep, (void *)2000, &big));
+  printf("deep: 2000 levels, sum %ld\n", sum);
+
+  static Handle tasks[100];
+  for (long i = 0; i < 100; i++)
+    tasks[i] = async_call_ex(tiny, (void *)i, &small);
+  static void *results[100];
+  await_all(tasks, 100, results);
+  sum = 0;
+  for (int i = 0; i < 100; i++) {
+    sum += (long)results[i];
+    async_free(tasks[i]);
+  }
+  printf("tiny: 100 tasks, sum %ld\n", sum);
+
+  // the big stack comes back from the pool of its own size class
+  sum = (long)await(async_call_ex(deep, (void *)2000, &big));
+  printf("deep again: 2000 levels, sum %ld\n", sum);
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  run_async_main(async_main, NULL);
+  return 0;
+}
@@ -0,0 +1,103 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address
+$$ -o ./build/tests/coop ./tests/coop.c -I src -L build -lasync
+!! ./build/tests/coop
+
+%% 16
+## recv: 1024 bytes, ticker ran 64 times
+## await: 1024 tasks, ticker ran 64 times
+##
+-------
+
+%% -1
+## recv: 1024 bytes, ticker ran 0 times
+## await: 1024 tasks, ticker ran 0 times
+##
+-------
+ */
+
+#include "../src/async.h"
+#include "../src/io.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define OPS 1024
+
+static volatile int ticks = 0;
+static volatile int hogging = 0;
+static volatile int done = 0;
+
+// counts how often it gets to run while a hog is busy
+void ticker(void *args) {
+  while (!done) {
+    if (hogging)
+      ticks++;
+    async_skip();
+  }
+  async_return(NULL);
+}
+
+void nothing(void *args) { async_return(NULL); }
+
+// reads a byte at a time from a socket that always has more
+void reader(void *args) {
+  int fd = *(int *)args;
+  long got = 0;
+  hogging = 1;
+  for (int i = 0; i < OPS; i++) {
+    char c;
+    got += await_async_recv(fd, &c, 1, 0);
+  }
+  hogging = 0;
+  async_return((void *)got);
+}
+
+// awaits tasks that all finished already
+void awaiter(void *args) {
+  Handle *hs = args;
+  hogging = 1;
+  for (int i = 0; i < OPS; i++)
+    await(hs[i]);
+  hogging = 0;
+  async_return(NULL);
+}
+
+static int run(AsyncFunction *fn, void *args) {
+  ticks = done = 0;
+  Handle t = async_call(ticker, NULL);
+  void *res = await(async_call(fn, args));
+  done = 1;
+  await(t);
+  return (int)(long)res;
+}
+
+void async_main(void *args) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    return perror("socketpair"), exit(1);
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  char buf[OPS] = {0};
+  if (write(fds[1], buf, OPS) != OPS)
+    return perror("write"), exit(1);
+  int got = run(reader, &fds[0]);
+  printf("recv: %d bytes, ticker ran %d times\n", got, ticks);
+
+  static Handle hs[OPS];
+  for (int i = 0; i < OPS; i++)
+    hs[i] = async_call(nothing, NULL);
+  async_skip();
+  run(awaiter, hs);
+  printf("await: %d tasks, ticker ran %d times\n", OPS, ticks);
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  RuntimeOptions opts = {.scheduler = SCHEDULER_QUEUE};
+  if (scanf("%d", &opts.coop_budget) != 1)
+    return 1;
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}
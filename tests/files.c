@@ -0,0 +1,144 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address -pthread
+$$ -o ./build/tests/files ./tests/files.c -I src -L build -lasync
+!! ./build/tests/files
+
+%% graph epoll
+## wrote 1048576 bytes, fsync 0
+## read back 1048576 bytes: ok
+## sent 1048576 bytes, received 1048576: ok
+## 2000 more calls, task table flat: yes
+## bad fd: EBADF
+##
+-------
+
+%% queue uring
+## wrote 1048576 bytes, fsync 0
+## read back 1048576 bytes: ok
+## sent 1048576 bytes, received 1048576: ok
+## 2000 more calls, task table flat: yes
+## bad fd: EBADF
+##
+-------
+
+%% steal epoll
+## wrote 1048576 bytes, fsync 0
+## read back 1048576 bytes: ok
+## sent 1048576 bytes, received 1048576: ok
+## 2000 more calls, task table flat: yes
+## bad fd: EBADF
+##
+-------
+ */
+
+#define _GNU_SOURCE
+#include "../src/async.h"
+#include "../src/io.h"
+#include "../src/scheduler.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define SIZE (1 << 20)
+#define CHUNK (64 * 1024)
+
+static char byte_at(long i) { return (char)(i * 7 + i / 4096); }
+
+static char *data;
+
+void receiver(void *args) {
+  int fd = (int)(long)args;
+  static char buf[4096];
+  long total = 0;
+  bool ok = true;
+  int n = 0;
+  while ((n = await_async_recv(fd, buf, sizeof(buf), 0)) > 0) {
+    for (int i = 0; i < n; i++)
+      ok &= buf[i] == byte_at(total + i);
+    total += n;
+  }
+  async_return((void *)(ok ? total : -1));
+}
+
+void async_main(void *args) {
+  int fd = open(".", O_TMPFILE | O_RDWR, 0600);
+  if (fd == -1)
+    return perror("open"), exit(1);
+  data = malloc(SIZE);
+  for (long i = 0; i < SIZE; i++)
+    data[i] = byte_at(i);
+
+  Handle writes[SIZE / CHUNK];
+  for (int i = 0; i < SIZE / CHUNK; i++)
+    writes[i] = async_pwrite(fd, data + i * CHUNK, CHUNK, (off_t)i * CHUNK);
+  void *written[SIZE / CHUNK];
+  await_all(writes, SIZE / CHUNK, written);
+  long total = 0;
+  for (int i = 0; i < SIZE / CHUNK; i++)
+    total += (long)written[i];
+  printf("wrote %ld bytes, fsync %d\n", total, await_async_fsync(fd));
+
+  FileReader r;
+  file_reader_init(&r, fd, 0);
+  static char buf[10000];
+  bool ok = true;
+  ssize_t n = 0;
+  total = 0;
+  while ((n = await_file_read(&r, buf, sizeof(buf))) > 0) {
+    ok &= memcmp(buf, data + total, n) == 0;
+    total += n;
+  }
+  printf("read back %ld bytes: %s\n", total, ok && n == 0 ? "ok" : "mismatch");
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    return perror("socketpair"), exit(1);
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(fds[1], F_SETFL, O_NONBLOCK);
+  Handle h = async_call(receiver, (void *)(long)fds[1]);
+  file_reader_init(&r, fd, 0);
+  total = 0;
+  while ((n = await_file_send(&r, fds[0], CHUNK)) > 0)
+    total += n;
+  async_close(fds[0]);
+  long received = (long)await(h);
+  async_close(fds[1]);
+  printf("sent %ld bytes, received %ld: %s\n", total, received,
+         received == SIZE ? "ok" : "mismatch");
+
+  // the pool's tasks have to be given back once their result is in
+  for (int i = 0; i < 100; i++)
+    await_async_pwrite(fd, buf, 16, 0);
+  int before = global_pool()->len;
+  for (int i = 0; i < 1000; i++) {
+    await_async_pwrite(fd, buf, 16, 0);
+    await_async_fsync(fd);
+  }
+  printf("2000 more calls, task table flat: %s\n",
+         global_pool()->len <= before + 1 ? "yes" : "no");
+
+  close(fd);
+  int status = await_async_pread(fd, buf, sizeof(buf), 0);
+  printf("bad fd: %s\n", status == -1 && errno == EBADF ? "EBADF" : "?");
+  free(data);
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  char kind[16] = {0}, io[16] = {0};
+  if (scanf("%15s %15s", kind, io) != 2)
+    return 1;
+  RuntimeOptions opts = {0};
+  if (strcmp(kind, "queue") == 0)
+    opts.scheduler = SCHEDULER_QUEUE;
+  if (strcmp(kind, "steal") == 0)
+    opts = (RuntimeOptions){.scheduler = SCHEDULER_STEAL, .threads = 2};
+  if (strcmp(io, "uring") == 0)
+    opts.io_backend = IO_URING;
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}
@@ -0,0 +1,83 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address
+$$ -o ./build/tests/groups ./tests/groups.c -I src -L build -lasync
+!! ./build/tests/groups
+
+%%
+## weights 100 and 300 get 1:3: yes
+## capped at 20% gets 20%: yes
+## spawned children stay in the group: yes
+##
+-------
+ */
+
+#include "../src/async.h"
+#include <stdio.h>
+
+#define ROUNDS 20000
+
+static long rounds[3];
+static long total = 0;
+
+static void work() {
+  for (volatile int i = 0; i < 2000; i++)
+    ;
+}
+
+// the same amount of work per round in every group, until ROUNDS are done
+void spinner(void *args) {
+  long slot = (long)args;
+  while (total < ROUNDS) {
+    work();
+    rounds[slot]++;
+    total++;
+    async_skip();
+  }
+  async_return(NULL);
+}
+
+void spawner(void *args) {
+  Handle hs[4];
+  for (int i = 0; i < 4; i++)
+    hs[i] = async_call(spinner, args);
+  await_all(hs, 4, NULL);
+  async_return(NULL);
+}
+
+// starts tasks copies of fn in each of the groups a and b and returns the
+// share of the rounds b got
+static double share(int a, int b, AsyncFunction *fn, int tasks) {
+  rounds[0] = rounds[1] = total = 0;
+  Handle hs[8];
+  for (int i = 0; i < tasks; i++) {
+    CallOptions ga = {.group = a}, gb = {.group = b};
+    hs[2 * i] = async_call_ex(fn, (void *)0, &ga);
+    hs[2 * i + 1] = async_call_ex(fn, (void *)1, &gb);
+  }
+  await_all(hs, 2 * tasks, NULL);
+  return (double)rounds[1] / (rounds[0] + rounds[1]);
+}
+
+void async_main(void *args) {
+  double s =
+      share(async_group_create(300), async_group_create(100), spinner, 4);
+  printf("weights 100 and 300 get 1:3: %s\n",
+         s > 0.18 && s < 0.32 ? "yes" : "no");
+
+  int capped = async_group_create(100);
+  async_group_set_cap(capped, 20);
+  s = share(async_group_create(100), capped, spinner, 4);
+  printf("capped at 20%% gets 20%%: %s\n", s > 0.12 && s < 0.28 ? "yes" : "no");
+
+  // the weights only matter if the spinners end up in the spawners' groups
+  s = share(async_group_create(300), async_group_create(100), spawner, 1);
+  printf("spawned children stay in the group: %s\n",
+         s > 0.18 && s < 0.32 ? "yes" : "no");
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  RuntimeOptions opts = {.scheduler = SCHEDULER_FAIR};
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}
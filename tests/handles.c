@@ -0,0 +1,78 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address
+$$ -o ./build/tests/handles ./tests/handles.c -I src -L build -lasync
+!! ./build/tests/handles
+
+%%
+## many: 5000 tasks, sum 12497500
+## reused slot: same idx yes, new generation yes
+## stale await aborts: yes
+## stale free aborts: yes
+##
+-------
+ */
+
+#include "../src/async.h"
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void identity(void *args) { async_return(args); }
+
+// runs fn(h) in a child process and tells whether it died on an assert
+static bool aborts(void (*fn)(Handle), Handle h) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    // the assertion message is expected, keep it out of the test log
+    freopen("/dev/null", "w", stderr);
+    fn(h);
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+static void await_it(Handle h) { await(h); }
+static void free_it(Handle h) { async_free(h); }
+
+void async_main(void *args) {
+  // the checks fork, so they run before anything is printed
+  Handle old = async_call(identity, NULL);
+  await(old);
+  async_free(old);
+  bool stale_await = aborts(await_it, old);
+  bool stale_free = aborts(free_it, old);
+  Handle reused = async_call(identity, NULL);
+  await(reused);
+  async_free(reused);
+
+  // several chunks of the task table
+  static Handle hs[5000];
+  static void *results[5000];
+  for (long i = 0; i < 5000; i++)
+    hs[i] = async_call(identity, (void *)i);
+  await_all(hs, 5000, results);
+  long sum = 0;
+  for (int i = 0; i < 5000; i++) {
+    sum += (long)results[i];
+    async_free(hs[i]);
+  }
+  printf("many: 5000 tasks, sum %ld\n", sum);
+
+  printf("reused slot: same idx %s, new generation %s\n",
+         reused.idx == old.idx ? "yes" : "no",
+         reused.gen != old.gen ? "yes" : "no");
+
+  printf("stale await aborts: %s\n", stale_await ? "yes" : "no");
+  printf("stale free aborts: %s\n", stale_free ? "yes" : "no");
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  run_async_main(async_main, NULL);
+  return 0;
+}
@@ -0,0 +1,92 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address
+$$ -o ./build/tests/huge_stacks ./tests/huge_stacks.c -I src -L build -lasync
+!! ./build/tests/huge_stacks
+
+%%
+## 4000 tasks ran: yes
+## freeing kept the stacks warm: yes
+## second round reused them all: yes
+##
+-------
+ */
+
+#include "../src/async.h"
+#include "../src/scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TASKS 4000
+
+static long rss() {
+  long pages = 0, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  fscanf(f, "%ld %ld", &pages, &resident);
+  fclose(f);
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+// dirties half of its 16KB stack, leaving room for ld.so resolving symbols
+// lazily on it, and stays alive until everyone did
+void connection(void *args) {
+  volatile char buf[8 * 1024];
+  memset((char *)buf, 1, sizeof(buf));
+  async_skip();
+  async_return((void *)(long)buf[100]);
+}
+
+static int by_address(const void *a, const void *b) {
+  char *x = *(char **)a, *y = *(char **)b;
+  return (x > y) - (x < y);
+}
+
+static long given_back;
+
+// starts TASKS connections, waits for them and frees them, noting where
+// their stacks were; returns how many returned what they should
+static long run_round(void **bases) {
+  static Handle tasks[TASKS];
+  static void *results[TASKS];
+  for (int i = 0; i < TASKS; i++)
+    tasks[i] = async_call(connection, NULL);
+  await_all(tasks, TASKS, results);
+  long ok = 0;
+  long before = rss();
+  for (int i = 0; i < TASKS; i++) {
+    ok += (long)results[i];
+    bases[i] = get_task(tasks[i])->stack_base;
+    async_free(tasks[i]);
+  }
+  given_back = before - rss();
+  return ok;
+}
+
+void async_main(void *args) {
+  static void *first[TASKS], *second[TASKS];
+  long ran = run_round(first);
+  printf("%d tasks ran: %s\n", TASKS, ran == TASKS ? "yes" : "no");
+
+  // past STACK_WARM_POOL small pages would go back to the kernel, huge
+  // pages are never split up for that
+  long spike = (long)TASKS * 8 * 1024;
+  printf("freeing kept the stacks warm: %s\n",
+         given_back < spike / 4 ? "yes" : "no");
+
+  ran = run_round(second);
+  qsort(first, TASKS, sizeof(void *), by_address);
+  int reused = 0;
+  for (int i = 0; i < TASKS; i++)
+    reused += bsearch(&second[i], first, TASKS, sizeof(void *),
+                      by_address) != NULL;
+  printf("second round reused them all: %s\n",
+         ran == TASKS && reused == TASKS ? "yes" : "no");
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  RuntimeOptions opts = {.stack_huge_pages = true};
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}
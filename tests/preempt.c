@@ -0,0 +1,114 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address -pthread
+$$ -o ./build/tests/preempt ./tests/preempt.c -I src -L build -lasync
+!! ./build/tests/preempt
+
+%% graph 1000
+## preempted inside a region: yes
+## preempted outside a region: no
+## sums: 99999995000000.0 99999995000000.0
+## interleaved: yes
+##
+-------
+
+%% queue 1000
+## preempted inside a region: yes
+## preempted outside a region: no
+## sums: 99999995000000.0 99999995000000.0
+## interleaved: yes
+##
+-------
+
+%% graph 0
+## preempted inside a region: no
+## preempted outside a region: no
+## sums: 99999995000000.0 99999995000000.0
+## interleaved: no
+##
+-------
+ */
+
+#include "../src/async.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define TERMS 20000000
+
+static volatile int flag = 0;
+static volatile long progress[2] = {0};
+static volatile int interleaved = 0;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void setter(void *args) {
+  flag = 1;
+  async_return(NULL);
+}
+
+// spins until the setter ran or 200ms went by, never yielding on its own
+void hog(void *args) {
+  long region = (long)args;
+  if (region)
+    async_preemptible_begin();
+  double deadline = now() + 0.2;
+  while (!flag && now() < deadline)
+    ;
+  if (region)
+    async_preemptible_end();
+  async_return((void *)(long)flag);
+}
+
+// floating point state has to survive being switched out mid-loop
+void summer(void *args) {
+  long self = (long)args;
+  double sum = 0;
+  async_preemptible_begin();
+  for (long i = 0; i < TERMS; i++) {
+    sum += i * 0.5;
+    progress[self] = i + 1;
+    long other = progress[!self];
+    if (other > 0 && other < TERMS)
+      interleaved = 1;
+  }
+  async_preemptible_end();
+  static double sums[2];
+  sums[self] = sum;
+  async_return(&sums[self]);
+}
+
+void async_main(void *args) {
+  for (long region = 1; region >= 0; region--) {
+    flag = 0;
+    Handle h = async_call(hog, (void *)region);
+    Handle s = async_call(setter, NULL);
+    long preempted = (long)await(h);
+    await(s);
+    printf("preempted %s a region: %s\n", region ? "inside" : "outside",
+           preempted ? "yes" : "no");
+  }
+
+  Handle sums[2] = {async_call(summer, (void *)0),
+                    async_call(summer, (void *)1)};
+  double *results[2] = {0};
+  await_all(sums, 2, (void **)results);
+  printf("sums: %.1f %.1f\n", *results[0], *results[1]);
+  printf("interleaved: %s\n", interleaved ? "yes" : "no");
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  char kind[16] = {0};
+  long preempt_us = 0;
+  if (scanf("%15s %ld", kind, &preempt_us) != 2)
+    return 1;
+  RuntimeOptions opts = {.preempt_us = preempt_us};
+  if (strcmp(kind, "queue") == 0)
+    opts.scheduler = SCHEDULER_QUEUE;
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}
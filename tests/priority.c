@@ -0,0 +1,140 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address
+$$ -o ./build/tests/priority ./tests/priority.c -I src -L build -lasync
+!! ./build/tests/priority
+
+%%
+## strict: HHH abcabcabc
+## raised: ccc ababab
+## inherited: kk| xyxyxy
+## chain: cccb|mmm
+## given back: 0 0
+##
+-------
+ */
+
+#include "../src/async.h"
+#include "../src/scheduler.h"
+#include <stdio.h>
+
+static char log_buf[64];
+static int log_len = 0;
+
+static void note(char c) { log_buf[log_len++] = c; }
+
+static void flush(const char *what) {
+  log_buf[log_len] = 0;
+  printf("%s: %s\n", what, log_buf);
+  log_len = 0;
+}
+
+// notes its letter, then yields, for three rounds
+void spinner(void *args) {
+  for (int i = 0; i < 3; i++) {
+    note((char)(long)args);
+    async_skip();
+  }
+  async_return(NULL);
+}
+
+Handle spawn(char c, int priority) {
+  CallOptions opts = {.priority = priority};
+  return async_call_ex(spinner, (void *)(long)c, &opts);
+}
+
+void child(void *args) {
+  note('k');
+  async_skip();
+  note('k');
+  async_return(NULL);
+}
+
+// spawns bulk work and a low priority child, then waits for the child
+void urgent(void *args) {
+  Handle bulk[2] = {spawn('x', 0), spawn('y', 0)};
+  Handle c = async_call(child, NULL);
+  await(c);
+  note('|');
+  note(' ');
+  await_all(bulk, 2, NULL);
+  async_return(NULL);
+}
+
+// awaits a spinner of the same priority, which it spawns
+void middle(void *args) {
+  Handle *c = args;
+  *c = spawn('c', 0);
+  await(*c);
+  note('b');
+  async_return(NULL);
+}
+
+// b is already parked on c when this starts waiting for it, so c has to get
+// the priority through b to keep m from running first
+void top(void *args) {
+  Handle b = *(Handle *)args;
+  Handle m = spawn('m', 1);
+  await(b);
+  note('|');
+  await(m);
+  async_return(NULL);
+}
+
+void sleeper(void *args) {
+  async_sleep_ns(20000000);
+  async_return(NULL);
+}
+
+void sleepy_middle(void *args) {
+  Handle *c = args;
+  *c = async_call(sleeper, NULL);
+  await(*c);
+  async_return(NULL);
+}
+
+void impatient(void *args) {
+  await_timeout(*(Handle *)args, 1000000, NULL);
+  async_return(NULL);
+}
+
+void async_main(void *args) {
+  Handle hs[4] = {spawn('a', 0), spawn('b', 0), spawn('c', 0), spawn('H', 2)};
+  // H gets in first and then runs alone, the rest take turns
+  await(hs[3]);
+  note(' ');
+  await_all(hs, 3, NULL);
+  flush("strict");
+
+  hs[0] = spawn('a', 0);
+  hs[1] = spawn('b', 0);
+  hs[2] = spawn('c', 0);
+  async_set_priority(hs[2], 1);
+  await(hs[2]);
+  note(' ');
+  await_all(hs, 2, NULL);
+  flush("raised");
+
+  CallOptions opts = {.priority = ASYNC_PRIORITIES - 1};
+  await(async_call_ex(urgent, NULL, &opts));
+  flush("inherited");
+
+  Handle c;
+  Handle b = async_call(middle, &c);
+  async_skip();
+  CallOptions high = {.priority = 2};
+  await(async_call_ex(top, &b, &high));
+  flush("chain");
+
+  b = async_call(sleepy_middle, &c);
+  async_skip();
+  await(async_call_ex(impatient, &b, &high));
+  printf("given back: %d %d\n", get_task(b)->priority, get_task(c)->priority);
+  await(b);
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  RuntimeOptions opts = {.scheduler = SCHEDULER_PRIORITY};
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}
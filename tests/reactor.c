@@ -0,0 +1,60 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address
+$$ -o ./build/tests/reactor ./tests/reactor.c -I src -L build -lasync
+!! ./build/tests/reactor
+
+%%
+## reader: waiting
+## writer: sending
+## reader: got `hello'
+## main: done
+##
+-------
+ */
+
+#include "../src/async.h"
+#include "../src/io.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/socket.h>
+
+void reader(void *args) {
+  int fd = *(int *)args;
+  char buf[16] = {0};
+  printf("reader: waiting\n");
+  int n = await_async_recv(fd, buf, sizeof(buf) - 1, 0);
+  printf("reader: got `%.*s'\n", n, buf);
+  async_return(NULL);
+}
+
+void writer(void *args) {
+  int fd = *(int *)args;
+  for (int i = 0; i < 3; i++)
+    async_skip();
+  printf("writer: sending\n");
+  await_async_send(fd, "hello", 5, 0);
+  async_return(NULL);
+}
+
+void async_main(void *args) {
+  int sv[2] = {0};
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+    perror("socketpair");
+    async_return((void *)1);
+  }
+  fcntl(sv[0], F_SETFL, O_NONBLOCK);
+  fcntl(sv[1], F_SETFL, O_NONBLOCK);
+
+  Handle r = async_call(reader, &sv[0]);
+  Handle w = async_call(writer, &sv[1]);
+  await(r);
+  await(w);
+  printf("main: done\n");
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  run_async_main(async_main, NULL);
+  return 0;
+}
@@ -0,0 +1,59 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address -pthread
+$$ -o ./build/tests/shards ./tests/shards.c -I src -L build -lasync
+!! ./build/tests/shards
+
+%%
+## shard 0: sum 999000
+## shard 1: sum 999001
+## shard 2: sum 999002
+## shard 3: sum 999003
+##
+-------
+ */
+
+#include "../src/async.h"
+#include <stddef.h>
+#include <stdio.h>
+
+#define SHARDS 4
+
+static long sums[SHARDS];
+static int finished = 0;
+
+void doubler(void *args) {
+  long n = (long)args;
+  if (n % 3 == 0)
+    async_skip();
+  async_return((void *)(n * 2));
+}
+
+// runs once on every shard, each with its own task pool
+void async_main(void *args) {
+  int shard = async_shard_id();
+  static _Thread_local Handle all[1000];
+  static _Thread_local void *results[1000];
+  for (long i = 0; i < 1000; i++)
+    all[i] = async_call(doubler, (void *)i);
+  await_all(all, 1000, results);
+  long sum = shard;
+  for (int i = 0; i < 1000; i++)
+    sum += (long)results[i];
+  sums[shard] = sum;
+
+  if (shard != 0) {
+    __atomic_fetch_add(&finished, 1, __ATOMIC_RELEASE);
+    async_return(NULL);
+  }
+  while (__atomic_load_n(&finished, __ATOMIC_ACQUIRE) < SHARDS - 1)
+    async_skip();
+  for (int i = 0; i < SHARDS; i++)
+    printf("shard %d: sum %ld\n", i, sums[i]);
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  RuntimeOptions opts = {.shards = SHARDS};
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}
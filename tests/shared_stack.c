@@ -0,0 +1,98 @@
+/*
+$$ gcc -fPIC -ggdb
+$$ -o ./build/tests/shared_stack ./tests/shared_stack.c -I src -L build -lasync
+!! ./build/tests/shared_stack
+
+%%
+## locals: 100 tasks kept their frames
+## recursion: sum 55
+## uring: got `ping'
+##
+-------
+ */
+
+// No ASan here: the copier moves frames around behind its back.
+#include "../src/async.h"
+#include "../src/io.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+// fills a buffer on its stack, yields a few times and checks nobody else's
+// frames ended up in it
+void local_state(void *args) {
+  long id = (long)args;
+  char buf[1000];
+  memset(buf, (int)id, sizeof(buf));
+  for (int i = 0; i < 3; i++)
+    async_skip();
+  for (int i = 0; i < (int)sizeof(buf); i++) {
+    if (buf[i] != (char)id)
+      async_return((void *)0);
+  }
+  async_return((void *)1);
+}
+
+// yields at every level of the recursion
+long recurse(long n) {
+  volatile long local = n;
+  async_skip();
+  if (n == 0)
+    return 0;
+  return local + recurse(n - 1);
+}
+
+void deep(void *args) { async_return((void *)recurse((long)args)); }
+
+void echo(void *args) {
+  int fd = (int)(long)args;
+  char buf[32];
+  int n = await_async_recv(fd, buf, sizeof(buf), 0);
+  await_async_send(fd, buf, n, 0);
+  async_return(NULL);
+}
+
+// buffers live on the shared stack while the kernel works on them
+void ping() {
+  int fds[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(fds[1], F_SETFL, O_NONBLOCK);
+  Handle h = async_call(echo, (void *)(long)fds[1]);
+  char msg[16] = {0};
+  int len = snprintf(msg, sizeof(msg), "ping");
+  await_async_send(fds[0], msg, len, 0);
+  char buf[16] = {0};
+  await_async_recv(fds[0], buf, sizeof(buf) - 1, 0);
+  await(h);
+  printf("uring: got `%s'\n", buf);
+  async_close(fds[0]);
+  async_close(fds[1]);
+}
+
+void async_main(void *args) {
+  static Handle tasks[100];
+  for (long i = 0; i < 100; i++)
+    tasks[i] = async_call(local_state, (void *)i);
+  static void *ok[100];
+  await_all(tasks, 100, ok);
+  int kept = 0;
+  for (int i = 0; i < 100; i++)
+    kept += (long)ok[i];
+  printf("locals: %d tasks kept their frames\n", kept);
+
+  printf("recursion: sum %ld\n", (long)await(async_call(deep, (void *)10)));
+  ping();
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  RuntimeOptions opts = {
+      .io_backend = IO_URING,
+      .shared_stack_size = 256 << 10,
+  };
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}
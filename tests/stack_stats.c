@@ -0,0 +1,56 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address
+$$ -o ./build/tests/stack_stats ./tests/stack_stats.c -I src -L build -lasync
+!! ./build/tests/stack_stats
+
+%%
+## light: 20 tasks, peak below 4KB: yes, smaller stack: yes
+## heavy: 20 tasks, peak above 8KB: yes, smaller stack: no
+##
+-------
+ */
+
+#include "../src/async.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+void light(void *args) { async_return(args); }
+
+void heavy(void *args) {
+  volatile char buf[10 * 1024];
+  memset((char *)buf, 1, sizeof(buf));
+  async_return((void *)(long)buf[1]);
+}
+
+void report(const char *name, AsyncFunction *fn) {
+  AsyncStackStats stats[8];
+  int len = async_stack_stats(stats, 8);
+  for (int i = 0; i < len && i < 8; i++) {
+    if (stats[i].fn != fn)
+      continue;
+    printf("%s: %ld tasks, peak %s %dKB: %s, smaller stack: %s\n", name,
+           stats[i].tasks, fn == light ? "below" : "above",
+           fn == light ? 4 : 8,
+           (fn == light ? stats[i].peak < 4096 : stats[i].peak > 8192) ? "yes"
+                                                                       : "no",
+           stats[i].stack_size && stats[i].stack_size < STACK_SIZE ? "yes"
+                                                                   : "no");
+  }
+}
+
+void async_main(void *args) {
+  for (long i = 0; i < 20; i++) {
+    await(async_call(light, (void *)i));
+    await(async_call(heavy, NULL));
+  }
+  report("light", light);
+  report("heavy", heavy);
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  RuntimeOptions opts = {.stack_auto_size = true};
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}
@@ -0,0 +1,202 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address -pthread
+$$ -o ./build/tests/stackless ./tests/stackless.c -I src -L build -lasync
+!! ./build/tests/stackless
+
+%% graph
+## counter: 5
+## awaits stackful: 42
+## yields: p0 s0 p1 s1 p2 s2
+## both stackless: p0 p0 p1 p1 p2 p2
+## fd: got 7
+## many: 100000 tasks, sum 4999950000
+##
+-------
+
+%% queue
+## counter: 5
+## awaits stackful: 42
+## yields: p0 s0 p1 s1 p2 s2
+## both stackless: p0 p0 p1 p1 p2 p2
+## fd: got 7
+## many: 100000 tasks, sum 4999950000
+##
+-------
+
+%% steal
+## counter: 5
+## awaits stackful: 42
+## yields: p0 s0 p1 s1 p2 s2
+## both stackless: p0 p0 p1 p1 p2 p2
+## fd: got 7
+## many: 100000 tasks, sum 4999950000
+##
+-------
+ */
+
+#include "../src/async.h"
+#include "../src/pt.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef struct {
+  Pt pt;
+  int i;
+} Counter;
+
+PtStatus counter(Pt *pt) {
+  Counter *c = (Counter *)pt;
+  PT_BEGIN(pt);
+  for (c->i = 0; c->i < 5; c->i++)
+    PT_YIELD(pt);
+  PT_RETURN(pt, c->i);
+  PT_END(pt);
+}
+
+void answer(void *args) {
+  async_skip();
+  async_return((void *)42);
+}
+
+typedef struct {
+  Pt pt;
+  Handle child;
+} Parent;
+
+PtStatus parent(Pt *pt) {
+  Parent *p = (Parent *)pt;
+  void *res = NULL;
+  PT_BEGIN(pt);
+  p->child = async_call(answer, NULL);
+  PT_AWAIT(pt, p->child, res);
+  async_free(p->child);
+  PT_RETURN(pt, res);
+  PT_END(pt);
+}
+
+typedef struct {
+  Pt pt;
+  int i;
+} Printer;
+
+PtStatus printer(Pt *pt) {
+  Printer *p = (Printer *)pt;
+  PT_BEGIN(pt);
+  for (p->i = 0; p->i < 3; p->i++) {
+    printf(" p%d", p->i);
+    PT_YIELD(pt);
+  }
+  PT_END(pt);
+}
+
+void stackful_printer(void *args) {
+  for (int i = 0; i < 3; i++) {
+    printf(" s%d", i);
+    async_skip();
+  }
+  async_return(NULL);
+}
+
+typedef struct {
+  Pt pt;
+  int fd;
+  char c;
+} Reader;
+
+PtStatus reader(Pt *pt) {
+  Reader *r = (Reader *)pt;
+  PT_BEGIN(pt);
+  while (read(r->fd, &r->c, 1) != 1)
+    PT_WAIT_FD(pt, r->fd, EPOLLIN);
+  PT_RETURN(pt, r->c);
+  PT_END(pt);
+}
+
+void writer(void *args) {
+  int fd = (int)(long)args;
+  for (int i = 0; i < 3; i++)
+    async_skip();
+  char c = 7;
+  write(fd, &c, 1);
+  async_return(NULL);
+}
+
+typedef struct {
+  Pt pt;
+  long n;
+} Echo;
+
+PtStatus echo(Pt *pt) {
+  Echo *e = (Echo *)pt;
+  PT_BEGIN(pt);
+  PT_RETURN(pt, e->n);
+  PT_END(pt);
+}
+
+void async_main(void *args) {
+  Counter c;
+  printf("counter: %ld\n", (long)await(async_call_pt(counter, &c.pt)));
+
+  Parent p;
+  printf("awaits stackful: %ld\n", (long)await(async_call_pt(parent, &p.pt)));
+
+  // in steal mode with one worker the run order stays round robin
+  printf("yields:");
+  Printer pr;
+  Handle both[2] = {async_call_pt(printer, &pr.pt),
+                    async_call(stackful_printer, NULL)};
+  await_all(both, 2, NULL);
+  printf("\n");
+
+  printf("both stackless:");
+  Printer pa, pb;
+  Handle two[2] = {async_call_pt(printer, &pa.pt),
+                   async_call_pt(printer, &pb.pt)};
+  await_all(two, 2, NULL);
+  printf("\n");
+
+  int fds[2];
+  socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds);
+  Reader r = {.fd = fds[0]};
+  Handle rh = async_call_pt(reader, &r.pt);
+  async_orphan(async_call(writer, (void *)(long)fds[1]));
+  printf("fd: got %ld\n", (long)await(rh));
+  close(fds[0]);
+  close(fds[1]);
+
+  enum { MANY = 100000 };
+  Echo *echoes = calloc(MANY, sizeof(Echo));
+  Handle *hs = calloc(MANY, sizeof(Handle));
+  void **results = calloc(MANY, sizeof(void *));
+  for (long i = 0; i < MANY; i++) {
+    echoes[i].n = i;
+    hs[i] = async_call_pt(echo, &echoes[i].pt);
+  }
+  await_all(hs, MANY, results);
+  long sum = 0;
+  for (int i = 0; i < MANY; i++)
+    sum += (long)results[i];
+  printf("many: %d tasks, sum %ld\n", MANY, sum);
+  free(echoes);
+  free(hs);
+  free(results);
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  char kind[16] = {0};
+  if (scanf("%15s", kind) != 1)
+    return 1;
+  RuntimeOptions opts = {0};
+  if (strcmp(kind, "queue") == 0)
+    opts.scheduler = SCHEDULER_QUEUE;
+  if (strcmp(kind, "steal") == 0)
+    opts = (RuntimeOptions){.scheduler = SCHEDULER_STEAL, .threads = 1};
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}
@@ -0,0 +1,69 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address
+$$ -o ./build/tests/stacks ./tests/stacks.c -I src -L build -lasync
+!! ./build/tests/stacks
+
+%%
+## spike grew rss: yes
+## freeing gave it back: yes
+## reused stacks: 4000
+##
+-------
+ */
+
+#include "../src/async.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TASKS 4000
+
+static long rss() {
+  long pages = 0, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  fscanf(f, "%ld %ld", &pages, &resident);
+  fclose(f);
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+// dirties half of its 16KB stack, leaving room for ld.so resolving symbols
+// lazily on it, and stays alive until everyone did
+void connection(void *args) {
+  volatile char buf[8 * 1024];
+  memset((char *)buf, 1, sizeof(buf));
+  async_skip();
+  async_return((void *)(long)buf[100]);
+}
+
+void async_main(void *args) {
+  static Handle tasks[TASKS];
+  static void *results[TASKS];
+  long before = rss();
+  for (int i = 0; i < TASKS; i++)
+    tasks[i] = async_call(connection, NULL);
+  await_all(tasks, TASKS, NULL);
+  long peak = rss();
+  for (int i = 0; i < TASKS; i++)
+    async_free(tasks[i]);
+  long after = rss();
+
+  long spike = (long)TASKS * 8 * 1024;
+  printf("spike grew rss: %s\n", peak - before > spike / 2 ? "yes" : "no");
+  printf("freeing gave it back: %s\n",
+         peak - after > spike / 2 ? "yes" : "no");
+
+  for (int i = 0; i < TASKS; i++)
+    tasks[i] = async_call(connection, NULL);
+  await_all(tasks, TASKS, results);
+  long sum = 0;
+  for (int i = 0; i < TASKS; i++)
+    sum += (long)results[i];
+  printf("reused stacks: %ld\n", sum);
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  run_async_main(async_main, NULL);
+  return 0;
+}
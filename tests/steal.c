@@ -0,0 +1,95 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address -pthread
+$$ -o ./build/tests/steal ./tests/steal.c -I src -L build -lasync
+!! ./build/tests/steal
+
+%%
+## await_all: sum 999000
+## pairs: 64 x 100 round trips
+## orphans: 200 finished
+##
+-------
+ */
+
+#include "../src/async.h"
+#include "../src/io.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int orphans_done = 0;
+
+void doubler(void *args) {
+  long n = (long)args;
+  for (int i = 0; i < n % 7; i++)
+    async_skip();
+  async_return((void *)(n * 2));
+}
+
+// bounces a counter over a socketpair until it reaches 100
+void bouncer(void *args) {
+  int fd = (int)(long)args;
+  int rounds = 0;
+  unsigned char c = 0;
+  while (rounds < 100) {
+    if (await_async_recv(fd, (char *)&c, 1, 0) != 1)
+      break;
+    rounds++;
+    c++;
+    await_async_send(fd, (char *)&c, 1, 0);
+  }
+  async_return((void *)(long)rounds);
+}
+
+void orphan(void *args) {
+  async_skip();
+  __atomic_fetch_add(&orphans_done, 1, __ATOMIC_RELAXED);
+  async_return(NULL);
+}
+
+void async_main(void *args) {
+  static Handle all[1000];
+  static void *results[1000];
+  for (long i = 0; i < 1000; i++)
+    all[i] = async_call(doubler, (void *)i);
+  await_all(all, 1000, results);
+  long sum = 0;
+  for (int i = 0; i < 1000; i++)
+    sum += (long)results[i];
+  printf("await_all: sum %ld\n", sum);
+
+  static Handle pairs[128];
+  static int fds[128];
+  for (int i = 0; i < 64; i++) {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[2 * i]);
+    fcntl(fds[2 * i], F_SETFL, O_NONBLOCK);
+    fcntl(fds[2 * i + 1], F_SETFL, O_NONBLOCK);
+    pairs[2 * i] = async_call(bouncer, (void *)(long)fds[2 * i]);
+    pairs[2 * i + 1] = async_call(bouncer, (void *)(long)fds[2 * i + 1]);
+    char c = 0;
+    write(fds[2 * i], &c, 1);
+  }
+  static void *rounds[128];
+  await_all(pairs, 128, rounds);
+  int ok = 0;
+  for (int i = 0; i < 128; i++) {
+    ok += (long)rounds[i] >= 99;
+    async_close(fds[i]);
+  }
+  printf("pairs: %d x 100 round trips\n", ok / 2);
+
+  for (int i = 0; i < 200; i++)
+    async_orphan(async_call(orphan, NULL));
+  while (__atomic_load_n(&orphans_done, __ATOMIC_RELAXED) < 200)
+    async_skip();
+  printf("orphans: %d finished\n", orphans_done);
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  RuntimeOptions opts = {.scheduler = SCHEDULER_STEAL, .threads = 4};
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}
@@ -0,0 +1,152 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address -pthread
+$$ -o ./build/tests/timers ./tests/timers.c -I src -L build -lasync
+!! ./build/tests/timers
+
+%% graph epoll
+## woke in order: 10 20 30 70 300
+## slept at least as long as asked: yes
+## await_timeout on a slow child: timed out
+## await_timeout again: finished with 7
+## recv with nothing sent: timed out
+## peek with nothing sent: timed out
+## recv with a late sender: 1 byte
+## 1000 sleepers woke
+##
+-------
+
+%% queue uring
+## woke in order: 10 20 30 70 300
+## slept at least as long as asked: yes
+## await_timeout on a slow child: timed out
+## await_timeout again: finished with 7
+## recv with nothing sent: timed out
+## peek with nothing sent: timed out
+## recv with a late sender: 1 byte
+## 1000 sleepers woke
+##
+-------
+
+%% steal epoll
+## woke in order: 10 20 30 70 300
+## slept at least as long as asked: yes
+## await_timeout on a slow child: timed out
+## await_timeout again: finished with 7
+## recv with nothing sent: timed out
+## peek with nothing sent: timed out
+## recv with a late sender: 1 byte
+## 1000 sleepers woke
+##
+-------
+ */
+
+#include "../src/async.h"
+#include "../src/io.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#define MS 1000000L
+
+static long order[5];
+static int woken = 0;
+static int early = 0;
+
+static long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void sleeper(void *args) {
+  long ms = (long)args;
+  long start = now_ns();
+  async_sleep_ns(ms * MS);
+  if (now_ns() - start < ms * MS)
+    __atomic_fetch_add(&early, 1, __ATOMIC_RELAXED);
+  order[__atomic_fetch_add(&woken, 1, __ATOMIC_RELAXED)] = ms;
+  async_return(NULL);
+}
+
+void slow(void *args) {
+  async_sleep_ns(50 * MS);
+  async_return((void *)7);
+}
+
+void late_sender(void *args) {
+  async_sleep_ns(5 * MS);
+  await_async_send(*(int *)args, "x", 1, 0);
+  async_return(NULL);
+}
+
+void nap(void *args) {
+  async_sleep_ns((long)args);
+  async_return(NULL);
+}
+
+void async_main(void *args) {
+  static const long naps[] = {30, 300, 10, 70, 20};
+  Handle hs[5];
+  for (int i = 0; i < 5; i++)
+    hs[i] = async_call(sleeper, (void *)naps[i]);
+  await_all(hs, 5, NULL);
+  printf("woke in order: %ld %ld %ld %ld %ld\n", order[0], order[1], order[2],
+         order[3], order[4]);
+  printf("slept at least as long as asked: %s\n", early ? "no" : "yes");
+
+  Handle child = async_call(slow, NULL);
+  void *result = NULL;
+  bool done = await_timeout(child, 10 * MS, &result);
+  printf("await_timeout on a slow child: %s\n",
+         done ? "finished" : "timed out");
+  done = await_timeout(child, 1000 * MS, &result);
+  printf("await_timeout again: %s with %ld\n", done ? "finished" : "timed out",
+         (long)result);
+
+  static int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    return perror("socketpair"), exit(1);
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(fds[1], F_SETFL, O_NONBLOCK);
+  char c;
+  int n = await_async_recv_timeout(fds[0], &c, 1, 0, 10 * MS);
+  printf("recv with nothing sent: %s\n",
+         n == -1 && errno == ETIMEDOUT ? "timed out" : "got something");
+  // a one-shot request under io_uring, cancelled in the kernel
+  n = await_async_recv_timeout(fds[0], &c, 1, MSG_PEEK, 10 * MS);
+  printf("peek with nothing sent: %s\n",
+         n == -1 && errno == ETIMEDOUT ? "timed out" : "got something");
+  Handle sender = async_call(late_sender, &fds[1]);
+  n = await_async_recv_timeout(fds[0], &c, 1, 0, 1000 * MS);
+  printf("recv with a late sender: %d byte\n", n);
+  await(sender);
+  async_close(fds[0]);
+  async_close(fds[1]);
+
+  static Handle many[1000];
+  srand(1);
+  for (int i = 0; i < 1000; i++)
+    many[i] = async_call(nap, (void *)(rand() % (100 * MS)));
+  await_all(many, 1000, NULL);
+  printf("1000 sleepers woke\n");
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  char kind[16] = {0}, io[16] = {0};
+  if (scanf("%15s %15s", kind, io) != 2)
+    return 1;
+  RuntimeOptions opts = {0};
+  if (strcmp(kind, "queue") == 0)
+    opts.scheduler = SCHEDULER_QUEUE;
+  if (strcmp(kind, "steal") == 0)
+    opts = (RuntimeOptions){.scheduler = SCHEDULER_STEAL, .threads = 2};
+  if (strcmp(io, "uring") == 0)
+    opts.io_backend = IO_URING;
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}
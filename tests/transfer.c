@@ -0,0 +1,136 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address -pthread
+$$ -o ./build/tests/transfer ./tests/transfer.c -I src -L build -lasync
+!! ./build/tests/transfer
+
+%% graph
+## ping pong: 1000 items, sum 499500
+## bystander ran during ping pong: no
+## chain: 200 levels, sum 20100
+## shared child: 42 42
+##
+-------
+
+%% queue
+## ping pong: 1000 items, sum 499500
+## bystander ran during ping pong: no
+## chain: 200 levels, sum 20100
+## shared child: 42 42
+##
+-------
+
+%% steal
+## ping pong: 1000 items, sum 499500
+## bystander ran during ping pong: no
+## chain: 200 levels, sum 20100
+## shared child: 42 42
+##
+-------
+ */
+
+#include "../src/async.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+static Handle producer_task;
+static Handle consumer_task;
+static long slot = -1;
+static long consumed = 0;
+static int bystander_runs = 0;
+static volatile int exchanging = 0;
+
+void consumer(void *args) {
+  while (slot != -1) {
+    consumed += slot;
+    async_transfer(producer_task);
+  }
+  async_return(NULL);
+}
+
+void producer(void *args) {
+  // with several workers this may run before async_call returned to main
+  while (__atomic_load_n(&((Handle *)args)->idx, __ATOMIC_ACQUIRE) == 0)
+    async_skip();
+  producer_task = *(Handle *)args;
+  slot = 0;
+  consumer_task = async_call(consumer, NULL);
+  for (long i = 0; i < 1000; i++) {
+    slot = i;
+    async_transfer(consumer_task);
+    // the first transfer went through the run queue, the consumer was not
+    // parked yet; from here on they hand control straight to each other
+    exchanging = 1;
+  }
+  exchanging = 0;
+  slot = -1;
+  async_transfer(consumer_task);
+  await(consumer_task);
+  async_return((void *)consumed);
+}
+
+void bystander(void *args) {
+  for (int i = 0; i < 20; i++) {
+    if (exchanging)
+      bystander_runs++;
+    async_skip();
+  }
+  async_return(NULL);
+}
+
+// every level waits for the next one through a single waiter
+void level(void *args) {
+  long n = (long)args;
+  if (n == 0)
+    async_return(NULL);
+  Handle child = async_call(level, (void *)(n - 1));
+  void *sum = NULL;
+  await_all(&child, 1, &sum);
+  async_free(child);
+  async_return((void *)((long)sum + n));
+}
+
+void answer(void *args) {
+  async_skip();
+  async_return((void *)42);
+}
+
+void watcher(void *args) { async_return(await(*(Handle *)args)); }
+
+void async_main(void *args) {
+  static Handle self;
+  Handle h = async_call(producer, &self);
+  self.gen = h.gen;
+  __atomic_store_n(&self.idx, h.idx, __ATOMIC_RELEASE);
+  Handle by = async_call(bystander, NULL);
+  long sum = (long)await(self);
+  await(by);
+  printf("ping pong: 1000 items, sum %ld\n", sum);
+  printf("bystander ran during ping pong: %s\n", bystander_runs ? "yes" : "no");
+
+  sum = (long)await(async_call(level, (void *)200));
+  printf("chain: 200 levels, sum %ld\n", sum);
+
+  // two tasks waiting for one child, no handoff to either of them
+  static Handle child;
+  child = async_call(answer, NULL);
+  Handle watchers[2] = {async_call(watcher, &child),
+                        async_call(watcher, &child)};
+  void *results[2] = {0};
+  await_all(watchers, 2, results);
+  printf("shared child: %ld %ld\n", (long)results[0], (long)results[1]);
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  char kind[16] = {0};
+  if (scanf("%15s", kind) != 1)
+    return 1;
+  RuntimeOptions opts = {0};
+  if (strcmp(kind, "queue") == 0)
+    opts.scheduler = SCHEDULER_QUEUE;
+  if (strcmp(kind, "steal") == 0)
+    opts = (RuntimeOptions){.scheduler = SCHEDULER_STEAL, .threads = 1};
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}
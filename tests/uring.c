@@ -0,0 +1,86 @@
+/*
+$$ gcc -fPIC -ggdb -fsanitize=address
+$$ -o ./build/tests/uring ./tests/uring.c -I src -L build -lasync
+!! ./build/tests/uring
+
+%%
+## client 0: ping 0
+## client 1: ping 1
+## client 2: ping 2
+##
+-------
+ */
+
+#include "../src/async.h"
+#include "../src/io.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+void echo(void *args) {
+  int fd = (int)(long)args;
+  char buf[64];
+  int n = 0;
+  while ((n = await_async_recv(fd, buf, sizeof(buf), 0)) > 0) {
+    await_async_send(fd, buf, n, 0);
+  }
+  async_close(fd);
+  async_return(NULL);
+}
+
+void server(void *args) {
+  int listener = *(int *)args;
+  for (int i = 0; i < 3; i++) {
+    int fd = await_async_accept(listener, NULL, NULL);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    async_orphan(async_call(echo, (void *)(long)fd));
+  }
+  async_return(NULL);
+}
+
+void async_main(void *args) {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {0};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addr_len = sizeof(addr);
+  bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+  getsockname(listener, (struct sockaddr *)&addr, &addr_len);
+  listen(listener, 16);
+  fcntl(listener, F_SETFL, O_NONBLOCK);
+
+  Handle s = async_call(server, &listener);
+  for (int i = 0; i < 3; i++) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    char msg[16] = {0};
+    int len = snprintf(msg, sizeof(msg), "ping %d", i);
+    await_async_send(fd, msg, len, 0);
+    char buf[16] = {0};
+    int got = 0;
+    while (got < len) {
+      int n = await_async_recv(fd, buf + got, sizeof(buf) - 1 - got, 0);
+      if (n <= 0)
+        break;
+      got += n;
+    }
+    printf("client %d: %s\n", i, buf);
+    async_close(fd);
+  }
+  await(s);
+  async_close(listener);
+  async_return(NULL);
+}
+
+int main(int argc, char *argv[]) {
+  RuntimeOptions opts = {.io_backend = IO_URING};
+  run_async_main_ex(async_main, NULL, &opts);
+  return 0;
+}